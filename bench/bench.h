@@ -0,0 +1,19 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <cstdint>
+#include <cstdlib>
+
+/// Returns the argument at `index` as an integer, or `default_value` if it is missing.
+inline int64_t bench_arg(int argc, char** argv, int index, int64_t default_value) {
+    return index < argc ? std::strtoll(argv[index], nullptr, 10) : default_value;
+}
+
+/// Measures the per-call overhead of `anydsl_parallel_for` with empty and tiny bodies.
+/// Arguments: number of calls per measurement, number of iterations per call.
+int bench_parallel_for(int argc, char** argv);
+/// Compares the bandwidth of `memcpy` and `anydsl_copy` between host buffers, for sizes around the last-level cache size.
+/// Arguments: number of repetitions, largest size in bytes.
+int bench_copy(int argc, char** argv);
+
+#endif
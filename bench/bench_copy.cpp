@@ -0,0 +1,69 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+#include "anydsl_runtime.h"
+#include "bench.h"
+
+static size_t last_level_cache_size() {
+#if defined(_SC_LEVEL3_CACHE_SIZE)
+    long size = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    if (size > 0)
+        return size_t(size);
+#endif
+    return 32 << 20;
+}
+
+// Returns the best bandwidth in GB/s (bytes read plus bytes written) over a few repetitions
+template <typename F>
+static double bandwidth(size_t size, int32_t repetitions, F copy) {
+    copy();
+    double best = 0;
+    for (int32_t i = 0; i < repetitions; ++i) {
+        uint64_t start = anydsl_get_nano_time();
+        copy();
+        uint64_t time = std::max<uint64_t>(1, anydsl_get_nano_time() - start);
+        best = std::max(best, 2.0 * double(size) / double(time));
+    }
+    return best;
+}
+
+int bench_copy(int argc, char** argv) {
+    int32_t repetitions = int32_t(bench_arg(argc, argv, 1, 10));
+    size_t cache_size = last_level_cache_size();
+    size_t max_size = size_t(bench_arg(argc, argv, 2, int64_t(8 * cache_size)));
+
+    // Sizes double from 1 MiB up to the maximum, with extra points just around the cache size,
+    // where anydsl_copy switches from memcpy to streaming stores
+    std::vector<size_t> sizes;
+    for (size_t size = 1 << 20; size <= max_size; size *= 2)
+        sizes.push_back(size);
+    for (size_t size : { cache_size - cache_size / 8, cache_size + cache_size / 8 }) {
+        if (size <= max_size)
+            sizes.push_back(size);
+    }
+    std::sort(sizes.begin(), sizes.end());
+    sizes.erase(std::unique(sizes.begin(), sizes.end()), sizes.end());
+
+    auto src = static_cast<char*>(anydsl_alloc(0, int64_t(max_size)));
+    auto dst = static_cast<char*>(anydsl_alloc(0, int64_t(max_size)));
+    std::memset(src, 1, max_size);
+    std::memset(dst, 0, max_size);
+
+    std::printf("copy: best of %d, last-level cache of %zu KiB\n", repetitions, cache_size >> 10);
+    std::printf("%12s %16s %16s %8s\n", "size (KiB)", "memcpy (GB/s)", "anydsl (GB/s)", "speedup");
+    for (size_t size : sizes) {
+        double reference = bandwidth(size, repetitions, [&] { std::memcpy(dst, src, size); });
+        double threaded  = bandwidth(size, repetitions, [&] { anydsl_copy(0, src, 0, 0, dst, 0, int64_t(size)); });
+        std::printf("%12zu %16.2f %16.2f %7.2fx\n", size >> 10, reference, threaded, threaded / reference);
+    }
+
+    anydsl_release(0, src);
+    anydsl_release(0, dst);
+    return 0;
+}
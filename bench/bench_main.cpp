@@ -0,0 +1,35 @@
+#include <cstdio>
+#include <cstring>
+
+#include "bench.h"
+
+struct Benchmark {
+    const char* name;
+    int (*run)(int, char**);
+};
+
+static const Benchmark benchmarks[] = {
+    { "parallel_for", bench_parallel_for },
+    { "copy",         bench_copy },
+};
+
+// Usage: runtime_bench [name [args...]], runs every benchmark without arguments
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        int status = 0;
+        for (auto& benchmark : benchmarks) {
+            char* args[] = { const_cast<char*>(benchmark.name) };
+            status |= benchmark.run(1, args);
+        }
+        return status;
+    }
+    for (auto& benchmark : benchmarks) {
+        if (!std::strcmp(argv[1], benchmark.name))
+            return benchmark.run(argc - 1, argv + 1);
+    }
+    std::fprintf(stderr, "unknown benchmark '%s', available:", argv[1]);
+    for (auto& benchmark : benchmarks)
+        std::fprintf(stderr, " %s", benchmark.name);
+    std::fprintf(stderr, "\n");
+    return 1;
+}
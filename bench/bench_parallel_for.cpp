@@ -0,0 +1,51 @@
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "anydsl_runtime.h"
+#include "bench.h"
+
+static volatile int64_t sink;
+
+static void empty_body(void*, int32_t, int32_t) {}
+
+static void tiny_body(void*, int32_t begin, int32_t end) {
+    int64_t sum = 0;
+    for (int32_t i = begin; i < end; ++i)
+        sum += i;
+    sink = sum;
+}
+
+// Returns the best time per call in nanoseconds over a few measurements, to filter out noise
+static double time_per_call(int32_t num_threads, int32_t iterations, int64_t calls, void* body) {
+    double best = 1e30;
+    for (int run = 0; run < 5; ++run) {
+        uint64_t start = anydsl_get_nano_time();
+        for (int64_t i = 0; i < calls; ++i)
+            anydsl_parallel_for(num_threads, 0, iterations, nullptr, body);
+        best = std::min(best, double(anydsl_get_nano_time() - start) / double(calls));
+    }
+    return best;
+}
+
+int bench_parallel_for(int argc, char** argv) {
+    int64_t calls = bench_arg(argc, argv, 1, 20000);
+    int32_t iterations = int32_t(bench_arg(argc, argv, 2, 64));
+    int32_t hardware_threads = int32_t(std::max(1u, std::thread::hardware_concurrency()));
+
+    // 0 runs in the default arena, explicit counts go through the cached arenas
+    std::vector<int32_t> thread_counts = { 0, 1, std::max(1, hardware_threads / 2), hardware_threads };
+    thread_counts.erase(std::unique(thread_counts.begin(), thread_counts.end()), thread_counts.end());
+
+    std::printf("parallel_for: %lld calls of %d iterations, %d hardware threads\n", (long long)calls, iterations, hardware_threads);
+    std::printf("%8s %14s %14s\n", "threads", "empty (ns)", "tiny (ns)");
+    for (int32_t num_threads : thread_counts) {
+        // Warm up: starts the workers and creates the arena
+        anydsl_parallel_for(num_threads, 0, iterations, nullptr, (void*)tiny_body);
+        double empty = time_per_call(num_threads, iterations, calls, (void*)empty_body);
+        double tiny  = time_per_call(num_threads, iterations, calls, (void*)tiny_body);
+        std::printf("%8d %14.1f %14.1f\n", num_threads, empty, tiny);
+    }
+    return 0;
+}
@@ -0,0 +1,147 @@
+#include "alloc_tracker.h"
+#include "log.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <sstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <dlfcn.h>
+#endif
+
+bool AllocTracker::enabled_by_env() {
+    const char* env_var = std::getenv("ANYDSL_TRACK_ALLOC");
+    return env_var && std::strcmp(env_var, "0") != 0;
+}
+
+AllocTracker::AllocTracker()
+    : shards_(new Shard[num_shards])
+    , counters_(new Counters[max_platforms * max_devices])
+    , start_(std::chrono::steady_clock::now())
+{}
+
+AllocTracker::~AllocTracker() {
+    report_leaks(std::cerr);
+}
+
+AllocTracker::Shard& AllocTracker::shard(const void* ptr) const {
+    // Fibonacci hashing: allocations are aligned, the low bits of the pointers carry no information
+    uint64_t hash = uint64_t(reinterpret_cast<uintptr_t>(ptr)) * 0x9E3779B97F4A7C15ull;
+    return shards_[hash >> 58];
+}
+
+AllocTracker::Counters& AllocTracker::counters(int32_t device) const {
+    size_t plat = size_t(device & 0x0F);
+    size_t dev  = std::min(size_t(device >> 4), max_devices - 1);
+    return counters_[plat * max_devices + dev];
+}
+
+void AllocTracker::record_alloc(PlatformId plat, DeviceId dev, const void* ptr, int64_t size, void* caller) {
+    if (!ptr)
+        return;
+    int32_t device = device_mask(plat, dev);
+    int64_t time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count();
+    {
+        Shard& s = shard(ptr);
+        std::lock_guard<std::mutex> guard(s.lock);
+        s.allocations[ptr] = Allocation { size, device, time, caller };
+    }
+
+    Counters& c = counters(device);
+    int64_t live = c.live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+    int64_t peak = c.peak_bytes.load(std::memory_order_relaxed);
+    while (live > peak && !c.peak_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) ;
+    c.live_allocs.fetch_add(1, std::memory_order_relaxed);
+    c.total_allocs.fetch_add(1, std::memory_order_relaxed);
+}
+
+void AllocTracker::record_release(PlatformId plat, DeviceId dev, const void* ptr) {
+    if (!ptr)
+        return;
+    int32_t device = device_mask(plat, dev);
+    int64_t size;
+    {
+        Shard& s = shard(ptr);
+        std::lock_guard<std::mutex> guard(s.lock);
+        auto it = s.allocations.find(ptr);
+        if (it == s.allocations.end() || it->second.device != device)
+            return;
+        size = it->second.size;
+        s.allocations.erase(it);
+    }
+
+    Counters& c = counters(device);
+    c.live_bytes.fetch_sub(size, std::memory_order_relaxed);
+    c.live_allocs.fetch_sub(1, std::memory_order_relaxed);
+}
+
+AllocTracker::Stats AllocTracker::stats(PlatformId plat, DeviceId dev) const {
+    Counters& c = counters(device_mask(plat, dev));
+    return Stats {
+        c.live_bytes.load(std::memory_order_relaxed),
+        c.peak_bytes.load(std::memory_order_relaxed),
+        c.live_allocs.load(std::memory_order_relaxed),
+        c.total_allocs.load(std::memory_order_relaxed)
+    };
+}
+
+// Describes a call site as the module that contains it and the offset in that module, which addr2line can resolve
+static std::string describe_caller(void* caller) {
+    if (!caller)
+        return "unknown call site";
+    std::ostringstream os;
+#if defined(__unix__) || defined(__APPLE__)
+    Dl_info info;
+    if (dladdr(caller, &info) && info.dli_fname) {
+        os << info.dli_fname << "+0x" << std::hex << (reinterpret_cast<uintptr_t>(caller) - reinterpret_cast<uintptr_t>(info.dli_fbase));
+        if (info.dli_sname)
+            os << " (" << info.dli_sname << ")";
+        return os.str();
+    }
+#endif
+    os << caller;
+    return os.str();
+}
+
+size_t AllocTracker::report_leaks(std::ostream& os) const {
+    struct CallSite {
+        int64_t bytes = 0;
+        size_t count = 0;
+        int64_t first_time = INT64_MAX;
+    };
+    // Leaks are grouped by device, then by call site
+    std::map<std::pair<int32_t, void*>, CallSite> sites;
+    size_t num_leaks = 0;
+    int64_t leaked_bytes = 0;
+    for (size_t i = 0; i < num_shards; ++i) {
+        std::lock_guard<std::mutex> guard(shards_[i].lock);
+        for (auto& pair : shards_[i].allocations) {
+            auto& alloc = pair.second;
+            auto& site = sites[std::make_pair(alloc.device, alloc.caller)];
+            site.bytes += alloc.size;
+            site.count++;
+            site.first_time = std::min(site.first_time, alloc.time);
+            num_leaks++;
+            leaked_bytes += alloc.size;
+        }
+    }
+    if (num_leaks == 0)
+        return 0;
+
+    print(os, "AnyDSL: % allocation(s) of % bytes still live", num_leaks, leaked_bytes);
+    int32_t last_device = -1;
+    for (auto& pair : sites) {
+        int32_t device = pair.first.first;
+        if (device != last_device) {
+            auto stats = this->stats(PlatformId(device & 0x0F), DeviceId(device >> 4));
+            print(os, "    * platform %, device %: % bytes live, peak % bytes", device & 0x0F, device >> 4, stats.live_bytes, stats.peak_bytes);
+            last_device = device;
+        }
+        auto& site = pair.second;
+        print(os, "      + % allocation(s) of % bytes from %, the first after % ms",
+            site.count, site.bytes, describe_caller(pair.first.second), site.first_time / 1000000);
+    }
+    return num_leaks;
+}
@@ -0,0 +1,74 @@
+#ifndef ALLOC_TRACKER_H
+#define ALLOC_TRACKER_H
+
+#include "runtime.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <unordered_map>
+
+/// Records the memory allocated through the runtime, enabled with `ANYDSL_TRACK_ALLOC=1`.
+/// Live allocations are kept in a map split in shards, each with its own lock, so that threads
+/// allocating concurrently rarely contend. Live and peak bytes are counted per device.
+class AllocTracker {
+public:
+    struct Stats {
+        int64_t live_bytes;   ///< Bytes currently allocated
+        int64_t peak_bytes;   ///< Maximum number of bytes allocated at once
+        int64_t live_allocs;  ///< Allocations that have not been released yet
+        int64_t total_allocs; ///< Allocations done so far
+    };
+
+    /// Returns true if tracking is requested through the `ANYDSL_TRACK_ALLOC` environment variable.
+    static bool enabled_by_env();
+
+    AllocTracker();
+    /// Prints the allocations that are still live, grouped by device and call site.
+    ~AllocTracker();
+
+    /// Records an allocation, `caller` is the return address of the API function, or nullptr if unknown.
+    void record_alloc(PlatformId plat, DeviceId dev, const void* ptr, int64_t size, void* caller);
+    /// Records the release of an allocation. Pointers that are not tracked are ignored.
+    void record_release(PlatformId plat, DeviceId dev, const void* ptr);
+    Stats stats(PlatformId plat, DeviceId dev) const;
+    /// Prints the live allocations, returns their number.
+    size_t report_leaks(std::ostream& os) const;
+
+private:
+    static constexpr size_t num_shards = 64;
+    static constexpr size_t max_platforms = 16;
+    static constexpr size_t max_devices = 64;   ///< Devices past this number share the counters of the last one
+
+    struct Allocation {
+        int64_t size;
+        int32_t device;   ///< Platform and device, as in the masks of the C API
+        int64_t time;     ///< Nanoseconds since the start of tracking
+        void* caller;
+    };
+
+    struct alignas(64) Shard {
+        mutable std::mutex lock;
+        std::unordered_map<const void*, Allocation> allocations;
+    };
+
+    struct alignas(64) Counters {
+        std::atomic<int64_t> live_bytes { 0 };
+        std::atomic<int64_t> peak_bytes { 0 };
+        std::atomic<int64_t> live_allocs { 0 };
+        std::atomic<int64_t> total_allocs { 0 };
+    };
+
+    static int32_t device_mask(PlatformId plat, DeviceId dev) { return int32_t(plat) | int32_t(dev) << 4; }
+    Shard& shard(const void* ptr) const;
+    Counters& counters(int32_t device) const;
+
+    std::unique_ptr<Shard[]> shards_;
+    std::unique_ptr<Counters[]> counters_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+#endif
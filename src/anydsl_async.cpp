@@ -0,0 +1,160 @@
+#include <mutex>
+#include <vector>
+
+#include "anydsl_runtime.h"
+#include "handle_table.h"
+#include "thread_pool.h"
+#include "log.h"
+
+// Futures: every handle refers to a task that runs in the thread pool once all its
+// dependencies have completed. A handle is consumed exactly once, either by waiting
+// on it, or by passing it to anydsl_then/anydsl_when_all. Continuations are queued
+// on the tasks they depend on and scheduled by the last dependency that completes,
+// so that no thread ever blocks on a dependency. Waiting on a future blocks instead of
+// running other tasks, both inside and outside of the pool, because a task picked up while
+// waiting could be waiting for the caller (e.g. on a channel), and could then never return.
+struct Future {
+    TaskGroup done;                     ///< Pending until the task has completed
+    int32_t (*fun)(void*);              ///< Task body, or nullptr for anydsl_when_all
+    void* args;
+    int32_t id;
+    std::atomic<int32_t> deps;          ///< Dependencies that have not completed yet, plus one while the future is set up
+    std::atomic<int32_t> refs;          ///< One reference for the handle, one until the task has completed
+    std::mutex lock;
+    bool completed;
+    std::vector<Future*> continuations; ///< Futures to notify on completion
+};
+
+static HandleTable<Future> futures;
+// Group of all the future tasks in the pool: waiting is done on Future::done instead
+static TaskGroup future_tasks;
+
+static void dependency_done(Future*);
+
+static Future* get_future(int32_t id) {
+    Future* future = futures.get(id);
+    if (!future)
+        error("Invalid future handle %", id);
+    return future;
+}
+
+static Future* create_future(void* args, void* fun) {
+    int32_t id = futures.acquire();
+    if (id < 0)
+        error("Too many pending futures (maximum is %)", HandleTable<Future>::max_handles);
+
+    Future* future = futures.get(id);
+    future->fun = reinterpret_cast<int32_t (*)(void*)>(fun);
+    future->args = args;
+    future->id = id;
+    future->deps = 1;
+    future->refs = 2;
+    future->completed = false;
+    future->continuations.clear();
+    ThreadPool::instance().retain(future->done);
+    return future;
+}
+
+static void drop_ref(Future* future) {
+    if (future->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        futures.release(future->id);
+}
+
+static void complete(Future* future) {
+    std::vector<Future*> continuations;
+    {
+        std::lock_guard<std::mutex> lock(future->lock);
+        future->completed = true;
+        continuations.swap(future->continuations);
+    }
+    for (auto continuation : continuations)
+        dependency_done(continuation);
+    ThreadPool::instance().release(future->done);
+    drop_ref(future);
+}
+
+static void run_future(void* data, int64_t, int64_t) {
+    auto future = static_cast<Future*>(data);
+    future->fun(future->args);
+    complete(future);
+}
+
+static void dependency_done(Future* future) {
+    if (future->deps.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+    if (future->fun)
+        ThreadPool::instance().submit_detached(future_tasks, run_future, future);
+    else
+        complete(future);
+}
+
+// Makes `future` depend on the future of the handle `id`, and consumes the handle
+static void add_dependency(Future* future, int32_t id) {
+    Future* dependency = get_future(id);
+    future->deps.fetch_add(1, std::memory_order_relaxed);
+    bool completed;
+    {
+        std::lock_guard<std::mutex> lock(dependency->lock);
+        completed = dependency->completed;
+        if (!completed)
+            dependency->continuations.push_back(future);
+    }
+    if (completed)
+        dependency_done(future);
+    drop_ref(dependency);
+}
+
+int32_t anydsl_async(void* args, void* fun) {
+    Future* future = create_future(args, fun);
+    int32_t id = future->id;
+    dependency_done(future);
+    return id;
+}
+
+int32_t anydsl_then(int32_t id, void* args, void* fun) {
+    Future* future = create_future(args, fun);
+    int32_t then_id = future->id;
+    add_dependency(future, id);
+    dependency_done(future);
+    return then_id;
+}
+
+int32_t anydsl_when_all(const int32_t* ids, int32_t count) {
+    Future* future = create_future(nullptr, nullptr);
+    int32_t all_id = future->id;
+    for (int32_t i = 0; i < count; ++i)
+        add_dependency(future, ids[i]);
+    dependency_done(future);
+    return all_id;
+}
+
+void anydsl_wait(int32_t id) {
+    Future* future = get_future(id);
+    ThreadPool::instance().wait_blocked(future->done);
+    drop_ref(future);
+}
+
+// Dependency of the next task spawned by the thread, set by anydsl_then_next
+static thread_local int32_t next_dependency = -1;
+
+// Frontends can only pass task bodies to the runtime through spawn: anydsl_then_next makes
+// the next spawn of the calling thread a continuation of the given future, like anydsl_then.
+void anydsl_then_next(int32_t id) {
+    get_future(id);
+    if (next_dependency >= 0)
+        error("Continuation of future % was never spawned", next_dependency);
+    next_dependency = id;
+}
+
+// Spawned threads are futures without dependencies, unless anydsl_then_next was called before
+int32_t anydsl_spawn_thread(void* args, void* fun) {
+    int32_t dependency = next_dependency;
+    if (dependency < 0)
+        return anydsl_async(args, fun);
+    next_dependency = -1;
+    return anydsl_then(dependency, args, fun);
+}
+
+void anydsl_sync_thread(int32_t id) {
+    anydsl_wait(id);
+}
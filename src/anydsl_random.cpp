@@ -0,0 +1,105 @@
+#include "anydsl_runtime.h"
+#include "philox.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define ANYDSL_RANDOM_SSE2
+#endif
+
+// Bulk random numbers: element i of a (seed, stream) sequence is the number (i % 4) of
+// the Philox block with counter (i / 4, stream) and key seed. Elements only depend on
+// their index, so the result does not depend on the number of threads.
+
+// Number of elements generated per parallel iteration, a multiple of 16
+static constexpr int64_t random_block_size = 4096;
+
+struct RandomFill {
+    float* buf;
+    int64_t n;
+    uint64_t seed;
+    uint64_t stream;
+};
+
+static void fill_scalar(const RandomFill& fill, int64_t first, int64_t last) {
+    for (int64_t i = first & ~int64_t(3); i < last; i += 4) {
+        uint64_t block = uint64_t(i) / 4;
+        uint32_t ctr[4] = { uint32_t(block), uint32_t(block >> 32), uint32_t(fill.stream), uint32_t(fill.stream >> 32) };
+        philox::generate(ctr, uint32_t(fill.seed), uint32_t(fill.seed >> 32));
+        for (int j = 0; j < 4; ++j) {
+            if (i + j >= first && i + j < last)
+                fill.buf[i + j] = philox::to_float(ctr[j]);
+        }
+    }
+}
+
+#ifdef ANYDSL_RANDOM_SSE2
+// Returns the high and low halves of the products of the lanes of `a` by `m`
+static inline void mulhilo(__m128i a, __m128i m, __m128i& hi, __m128i& lo) {
+    __m128i even = _mm_mul_epu32(a, m);
+    __m128i odd  = _mm_mul_epu32(_mm_srli_epi64(a, 32), m);
+    __m128i p01 = _mm_unpacklo_epi32(even, odd);
+    __m128i p23 = _mm_unpackhi_epi32(even, odd);
+    lo = _mm_unpacklo_epi64(p01, p23);
+    hi = _mm_unpackhi_epi64(p01, p23);
+}
+
+// Generates four Philox blocks at once, one per lane, and writes their 16 numbers in order
+static void fill_sse2(const RandomFill& fill, int64_t first, int64_t last) {
+    const __m128i m0 = _mm_set1_epi32(int32_t(philox::M0));
+    const __m128i m1 = _mm_set1_epi32(int32_t(philox::M1));
+    const __m128i stream_lo = _mm_set1_epi32(int32_t(fill.stream));
+    const __m128i stream_hi = _mm_set1_epi32(int32_t(fill.stream >> 32));
+    const __m128 scale = _mm_set1_ps(1.0f / 16777216.0f);
+    int64_t i = first;
+    for (; i + 16 <= last; i += 16) {
+        uint64_t block = uint64_t(i) / 4;
+        __m128i c0 = _mm_set_epi32(int32_t(block + 3), int32_t(block + 2), int32_t(block + 1), int32_t(block));
+        __m128i c1 = _mm_set_epi32(int32_t((block + 3) >> 32), int32_t((block + 2) >> 32), int32_t((block + 1) >> 32), int32_t(block >> 32));
+        __m128i c2 = stream_lo;
+        __m128i c3 = stream_hi;
+        uint32_t k0 = uint32_t(fill.seed), k1 = uint32_t(fill.seed >> 32);
+        for (int r = 0; r < philox::rounds; ++r, k0 += philox::W0, k1 += philox::W1) {
+            __m128i hi0, lo0, hi1, lo1;
+            mulhilo(c0, m0, hi0, lo0);
+            mulhilo(c2, m1, hi1, lo1);
+            c0 = _mm_xor_si128(_mm_xor_si128(hi1, c1), _mm_set1_epi32(int32_t(k0)));
+            c1 = lo1;
+            c2 = _mm_xor_si128(_mm_xor_si128(hi0, c3), _mm_set1_epi32(int32_t(k1)));
+            c3 = lo0;
+        }
+        __m128 f0 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(c0, 8)), scale);
+        __m128 f1 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(c1, 8)), scale);
+        __m128 f2 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(c2, 8)), scale);
+        __m128 f3 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(c3, 8)), scale);
+        // Lane k of f0..f3 holds the numbers of block k
+        _MM_TRANSPOSE4_PS(f0, f1, f2, f3);
+        _mm_storeu_ps(fill.buf + i,      f0);
+        _mm_storeu_ps(fill.buf + i + 4,  f1);
+        _mm_storeu_ps(fill.buf + i + 8,  f2);
+        _mm_storeu_ps(fill.buf + i + 12, f3);
+    }
+    fill_scalar(fill, i, last);
+}
+#endif
+
+static void fill_blocks(void* data, int64_t begin, int64_t end) {
+    auto& fill = *static_cast<RandomFill*>(data);
+    int64_t first = begin * random_block_size;
+    int64_t last  = end * random_block_size < fill.n ? end * random_block_size : fill.n;
+#ifdef ANYDSL_RANDOM_SSE2
+    fill_sse2(fill, first, last);
+#else
+    fill_scalar(fill, first, last);
+#endif
+}
+
+void anydsl_random_fill_f32(float* buf, int64_t n, uint64_t seed, uint64_t stream) {
+    if (n <= 0)
+        return;
+    RandomFill fill = { buf, n, seed, stream };
+    int64_t num_blocks = (n + random_block_size - 1) / random_block_size;
+    if (num_blocks == 1)
+        fill_blocks(&fill, 0, 1);
+    else
+        anydsl_parallel_for_i64(0, 0, num_blocks, &fill, reinterpret_cast<void*>(fill_blocks));
+}
@@ -1,6 +1,10 @@
+#include <algorithm>
 #include <random>
 #include <chrono>
 #include <locale>
+#include <deque>
+#include <fstream>
+#include <memory>
 #include <mutex>
 #include <sstream>
 
@@ -10,17 +14,24 @@
 #include "anydsl_jit.h"
 
 #include "runtime.h"
+#include "alloc_tracker.h"
 #include "platform.h"
 #include "dummy_platform.h"
 #include "cpu_platform.h"
+#include "handle_table.h"
+#include "numa.h"
+#include "thread_pool.h"
 
 #ifdef AnyDSL_runtime_HAS_TBB_SUPPORT
 #define NOMINMAX
 #include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
 #include <tbb/task_arena.h>
 #include <tbb/task_group.h>
-#include <tbb/concurrent_unordered_map.h>
-#include <tbb/concurrent_queue.h>
+#include <tbb/task_scheduler_observer.h>
+#include <list>
+#include <map>
+#include <tuple>
 #else
 #include <thread>
 #endif
@@ -84,16 +95,140 @@ bool anydsl_device_check_feature_support(int32_t mask, const char* feature) {
     return runtime().device_check_feature_support(to_platform(mask), to_device(mask), feature);
 }
 
+// Return address of the calling API function, recorded as the call site of tracked allocations
+#if defined(__GNUC__)
+#define ANYDSL_CALLER() __builtin_return_address(0)
+#else
+#define ANYDSL_CALLER() nullptr
+#endif
+
 void* anydsl_alloc(int32_t mask, int64_t size) {
-    return runtime().alloc(to_platform(mask), to_device(mask), size);
+    return runtime().alloc(to_platform(mask), to_device(mask), size, ANYDSL_CALLER());
 }
 
 void* anydsl_alloc_host(int32_t mask, int64_t size) {
-    return runtime().alloc_host(to_platform(mask), to_device(mask), size);
+    return runtime().alloc_host(to_platform(mask), to_device(mask), size, ANYDSL_CALLER());
 }
 
 void* anydsl_alloc_unified(int32_t mask, int64_t size) {
-    return runtime().alloc_unified(to_platform(mask), to_device(mask), size);
+    return runtime().alloc_unified(to_platform(mask), to_device(mask), size, ANYDSL_CALLER());
+}
+
+void* anydsl_alloc_ex(int32_t mask, int64_t size, int32_t flags) {
+    return runtime().alloc_ex(to_platform(mask), to_device(mask), size, flags, ANYDSL_CALLER());
+}
+
+bool anydsl_memory_stats(int32_t mask, MemoryStats* stats) {
+    AllocTracker* tracker = runtime().alloc_tracker();
+    if (!tracker) {
+        *stats = MemoryStats { 0, 0, 0, 0 };
+        return false;
+    }
+    auto device_stats = tracker->stats(to_platform(mask), to_device(mask));
+    stats->live_bytes   = device_stats.live_bytes;
+    stats->peak_bytes   = device_stats.peak_bytes;
+    stats->live_allocs  = device_stats.live_allocs;
+    stats->total_allocs = device_stats.total_allocs;
+    return true;
+}
+
+int32_t anydsl_page_kind(int32_t mask, void* ptr) {
+    return runtime().page_kind(to_platform(mask), to_device(mask), ptr);
+}
+
+// Arenas: a single buffer of the device, from which allocations are carved with a bump pointer.
+// Allocations are sub-buffers that share the memory of the arena, so that the platform only
+// allocates memory once, no matter how many allocations the arena serves between resets.
+struct DeviceArena {
+    int32_t device;
+    void* buffer;
+    int64_t capacity;
+    int64_t min_align;              ///< Alignment of the sub-buffer offsets required by the platform
+    bool release_subs;              ///< Whether sub-buffers are objects that must be released on reset
+    std::atomic<int64_t> offset;
+    std::mutex lock;
+    std::vector<void*> sub_buffers;
+};
+
+static HandleTable<DeviceArena> device_arenas;
+
+static DeviceArena* get_arena(int32_t id) {
+    DeviceArena* arena = device_arenas.get(id);
+    if (!arena)
+        error("Invalid arena handle %", id);
+    return arena;
+}
+
+int32_t anydsl_arena_create(int32_t mask, int64_t capacity) {
+    if (capacity <= 0)
+        error("Invalid arena capacity %", capacity);
+    int32_t id = device_arenas.acquire();
+    if (id < 0)
+        error("Too many arenas (maximum is %)", HandleTable<DeviceArena>::max_handles);
+    DeviceArena* arena = device_arenas.get(id);
+    arena->device = mask;
+    arena->buffer = runtime().alloc(to_platform(mask), to_device(mask), capacity, ANYDSL_CALLER());
+    arena->capacity = capacity;
+    arena->min_align = runtime().sub_buffer_alignment(to_platform(mask), to_device(mask));
+    arena->release_subs = runtime().sub_buffers_need_release(to_platform(mask), to_device(mask));
+    arena->offset = 0;
+    arena->sub_buffers.clear();
+    return id;
+}
+
+void* anydsl_arena_alloc(int32_t id, int64_t size, int64_t align) {
+    DeviceArena* arena = get_arena(id);
+    if (align <= 0)
+        align = 64;
+    if (align & (align - 1))
+        error("Invalid arena alignment %", align);
+    if (size <= 0)
+        return nullptr;
+    align = std::max(align, arena->min_align);
+
+    int64_t offset = arena->offset.load(std::memory_order_relaxed);
+    int64_t begin;
+    do {
+        begin = (offset + align - 1) & ~(align - 1);
+        if (begin + size > arena->capacity)
+            return nullptr;
+    } while (!arena->offset.compare_exchange_weak(offset, begin + size, std::memory_order_relaxed));
+
+    void* ptr = runtime().sub_buffer(to_platform(arena->device), to_device(arena->device), arena->buffer, begin, size);
+    if (arena->release_subs) {
+        std::lock_guard<std::mutex> guard(arena->lock);
+        arena->sub_buffers.push_back(ptr);
+    }
+    return ptr;
+}
+
+void anydsl_arena_reset(int32_t id) {
+    DeviceArena* arena = get_arena(id);
+    std::lock_guard<std::mutex> guard(arena->lock);
+    for (void* ptr : arena->sub_buffers)
+        runtime().release_sub_buffer(to_platform(arena->device), to_device(arena->device), ptr);
+    arena->sub_buffers.clear();
+    arena->offset = 0;
+}
+
+void anydsl_arena_destroy(int32_t id) {
+    anydsl_arena_reset(id);
+    DeviceArena* arena = get_arena(id);
+    runtime().release(to_platform(arena->device), to_device(arena->device), arena->buffer);
+    device_arenas.release(id);
+}
+
+void* anydsl_map_file(int32_t mask, const char* path, int64_t offset, int64_t size, int32_t flags) {
+    return runtime().map_file(to_platform(mask), to_device(mask), path, offset, size, flags);
+}
+
+void anydsl_unmap(int32_t mask, void* ptr) {
+    runtime().unmap(to_platform(mask), to_device(mask), ptr);
+}
+
+int64_t anydsl_file_size(const char* path) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    return file ? int64_t(file.tellg()) : -1;
 }
 
 void* anydsl_get_device_ptr(int32_t mask, void* ptr) {
@@ -108,6 +243,46 @@ void anydsl_release_host(int32_t mask, void* ptr) {
     runtime().release_host(to_platform(mask), to_device(mask), ptr);
 }
 
+void anydsl_trim() {
+    CpuAllocator::instance().trim();
+}
+
+void anydsl_set_alloc_cache_limit(int64_t limit) {
+    CpuAllocator::instance().set_limit(limit > 0 ? size_t(limit) : 0);
+}
+
+void anydsl_alloc_cache_stats(AllocCacheStats* stats) {
+    auto cache_stats = CpuAllocator::instance().stats();
+    stats->hits     = cache_stats.hits;
+    stats->misses   = cache_stats.misses;
+    stats->retained = cache_stats.retained;
+    stats->limit    = cache_stats.limit;
+}
+
+// Host devices 1 to N are the NUMA nodes, device 0 is the whole machine
+static int32_t host_node(int32_t mask) {
+    if (to_platform(mask) != PlatformId(ANYDSL_HOST))
+        error("Device % is not a host device", mask);
+    int32_t node = CpuPlatform::node(to_device(mask));
+    if (node >= int32_t(numa_nodes().size()))
+        error("Invalid NUMA node %", node);
+    return node;
+}
+
+int32_t anydsl_numa_node_count() {
+    return int32_t(numa_nodes().size());
+}
+
+bool anydsl_bind_thread(int32_t mask) {
+    int32_t node = host_node(mask);
+    return node < 0 || bind_current_thread(size_t(node));
+}
+
+void anydsl_unbind_thread(int32_t mask) {
+    if (host_node(mask) >= 0)
+        unbind_current_thread();
+}
+
 void anydsl_copy(
     int32_t mask_src, const void* src, int64_t offset_src,
     int32_t mask_dst, void* dst, int64_t offset_dst, int64_t size) {
@@ -116,6 +291,86 @@ void anydsl_copy(
         to_platform(mask_dst), to_device(mask_dst), dst, offset_dst, size);
 }
 
+struct DeviceStream {
+    int32_t device;
+    void* stream;
+};
+
+struct DeviceEvent {
+    int32_t device;
+    void* event;
+};
+
+static HandleTable<DeviceStream> device_streams;
+static HandleTable<DeviceEvent> device_events;
+
+static DeviceStream* get_stream(int32_t id) {
+    DeviceStream* stream = device_streams.get(id);
+    if (!stream)
+        error("Invalid stream handle %", id);
+    return stream;
+}
+
+int32_t anydsl_stream_create(int32_t mask) {
+    int32_t id = device_streams.acquire();
+    if (id < 0)
+        error("Too many streams (maximum is %)", HandleTable<DeviceStream>::max_handles);
+    DeviceStream* stream = device_streams.get(id);
+    stream->device = mask;
+    stream->stream = runtime().create_stream(to_platform(mask), to_device(mask));
+    return id;
+}
+
+void anydsl_stream_destroy(int32_t id) {
+    DeviceStream* stream = get_stream(id);
+    runtime().destroy_stream(to_platform(stream->device), to_device(stream->device), stream->stream);
+    device_streams.release(id);
+}
+
+void anydsl_stream_synchronize(int32_t id) {
+    DeviceStream* stream = get_stream(id);
+    runtime().synchronize_stream(to_platform(stream->device), to_device(stream->device), stream->stream);
+}
+
+void anydsl_copy_async(
+    int32_t mask_src, const void* src, int64_t offset_src,
+    int32_t mask_dst, void* dst, int64_t offset_dst, int64_t size, int32_t id) {
+    DeviceStream* stream = get_stream(id);
+    runtime().copy_async(
+        to_platform(mask_src), to_device(mask_src), src, offset_src,
+        to_platform(mask_dst), to_device(mask_dst), dst, offset_dst, size,
+        to_platform(stream->device), to_device(stream->device), stream->stream);
+}
+
+int32_t anydsl_event_record(int32_t stream_id) {
+    DeviceStream* stream = get_stream(stream_id);
+    int32_t id = device_events.acquire();
+    if (id < 0)
+        error("Too many events (maximum is %)", HandleTable<DeviceEvent>::max_handles);
+    DeviceEvent* event = device_events.get(id);
+    event->device = stream->device;
+    event->event = runtime().record_event(to_platform(stream->device), to_device(stream->device), stream->stream);
+    return id;
+}
+
+static DeviceEvent* get_event(int32_t id) {
+    DeviceEvent* event = device_events.get(id);
+    if (!event)
+        error("Invalid event handle %", id);
+    return event;
+}
+
+void anydsl_event_wait(int32_t id) {
+    DeviceEvent* event = get_event(id);
+    runtime().wait_event(to_platform(event->device), to_device(event->device), event->event);
+    device_events.release(id);
+}
+
+void anydsl_device_wait_event(int32_t id) {
+    DeviceEvent* event = get_event(id);
+    runtime().device_wait_event(to_platform(event->device), to_device(event->device), event->event);
+}
+
 void anydsl_launch_kernel(
     int32_t mask, const char* file_name, const char* kernel_name,
     const uint32_t* grid, const uint32_t* block,
@@ -211,133 +466,780 @@ uint64_t anydsl_random_val_u64() {
     return std_dist_u64(std_gen);
 }
 
+// Parameters of a reduction: `body(args, begin, end, acc)` accumulates a range
+// into `acc`, and `combine(args, acc, other)` merges `other` into `acc`.
+struct ParallelReduce {
+    const void* identity;
+    size_t elem_size;
+    void* args;
+    void (*body)(void*, int32_t, int32_t, void*);
+    void (*combine)(void*, void*, const void*);
+
+    ParallelReduce(const void* identity, int32_t elem_size, void* args, void* body, void* combine)
+        : identity(identity)
+        , elem_size(elem_size)
+        , args(args)
+        , body(reinterpret_cast<void (*) (void*, int32_t, int32_t, void*)>(body))
+        , combine(reinterpret_cast<void (*) (void*, void*, const void*)>(combine))
+    {}
+
+    void* new_accumulator() const {
+        void* acc = Runtime::aligned_malloc((elem_size + 63) & ~size_t(63), 64);
+        std::memcpy(acc, identity, elem_size);
+        return acc;
+    }
+};
+
+// Per-thread scratch memory, used as a bump allocator over a list of blocks.
+// Blocks are allocated and first touched by the thread that owns them, which
+// keeps them local to its NUMA node when the worker threads are pinned.
+class ScratchArena {
+public:
+    struct Mark {
+        size_t block;
+        size_t offset;
+    };
+
+    ScratchArena() : block_(0), offset_(0), base_{0, 0} {}
+
+    ~ScratchArena() {
+        for (auto& block : blocks_)
+            Runtime::aligned_free(block.data);
+    }
+
+    void* alloc(size_t size) {
+        // Every allocation starts on its own cache line
+        size = (size + 63) & ~size_t(63);
+        for (; block_ < blocks_.size(); ++block_, offset_ = 0) {
+            if (offset_ + size <= blocks_[block_].size) {
+                void* ptr = blocks_[block_].data + offset_;
+                offset_ += size;
+                return ptr;
+            }
+        }
+        size_t block_size = std::max(size, blocks_.empty() ? min_block_size : 2 * blocks_.back().size);
+        blocks_.push_back(Block { static_cast<char*>(Runtime::aligned_malloc(block_size, 64)), block_size });
+        offset_ = size;
+        return blocks_.back().data;
+    }
+
+    Mark mark() const { return Mark { block_, offset_ }; }
+    void restore(Mark mark) { block_ = mark.block; offset_ = mark.offset; }
+
+    /// Releases the memory allocated since the start of the current loop chunk, or all of it outside loops.
+    void reset() {
+        restore(base_);
+        if (base_.block == 0 && base_.offset == 0)
+            coalesce();
+    }
+
+    /// Makes the scratch memory allocated by a loop chunk live only as long as the chunk.
+    class Scope {
+    public:
+        Scope(ScratchArena& arena) : arena_(arena), saved_(arena.mark()), saved_base_(arena.base_) { arena.base_ = saved_; }
+        ~Scope() { arena_.base_ = saved_base_; arena_.restore(saved_); }
+    private:
+        ScratchArena& arena_;
+        Mark saved_;
+        Mark saved_base_;
+    };
+
+private:
+    static constexpr size_t min_block_size = 64 * 1024;
+
+    struct Block {
+        char* data;
+        size_t size;
+    };
+
+    // Replaces the blocks with a single one that holds all of them, so that the next uses of the arena never grow it
+    void coalesce() {
+        if (blocks_.size() <= 1)
+            return;
+        size_t total = 0;
+        for (auto& block : blocks_) {
+            total += block.size;
+            Runtime::aligned_free(block.data);
+        }
+        blocks_.clear();
+        blocks_.push_back(Block { static_cast<char*>(Runtime::aligned_malloc(total, 64)), total });
+    }
+
+    std::vector<Block> blocks_;
+    size_t block_;
+    size_t offset_;
+    Mark base_;
+};
+
+static thread_local ScratchArena scratch_arena;
+
+void* anydsl_thread_scratch(int64_t size) {
+    return scratch_arena.alloc(size_t(size));
+}
+
+void anydsl_thread_scratch_reset() {
+    scratch_arena.reset();
+}
+
 #ifndef AnyDSL_runtime_HAS_TBB_SUPPORT // C++11 threads version
-static std::unordered_map<int32_t, std::thread> thread_pool;
-static std::vector<int32_t> free_ids;
-static std::mutex thread_lock;
+template <typename Index>
+struct ParallelForBody {
+    void (*fun)(void*, Index, Index);
+    void* args;
+};
+
+template <typename Index>
+static void run_parallel_for_body(void* data, int64_t begin, int64_t end) {
+    auto body = static_cast<ParallelForBody<Index>*>(data);
+    ScratchArena::Scope scratch_scope(scratch_arena);
+    body->fun(body->args, Index(begin), Index(end));
+}
 
 void anydsl_parallel_for(int32_t num_threads, int32_t lower, int32_t upper, void* args, void* fun) {
-    // Get number of available hardware threads
-    if (num_threads == 0) {
-        num_threads = std::thread::hardware_concurrency();
-        // hardware_concurrency is implementation defined, may return 0
-        num_threads = (num_threads == 0) ? 1 : num_threads;
-    }
+    ParallelForBody<int32_t> body = { reinterpret_cast<void (*) (void*, int32_t, int32_t)>(fun), args };
 
-    void (*fun_ptr) (void*, int32_t, int32_t) = reinterpret_cast<void (*) (void*, int32_t, int32_t)>(fun);
-    const int32_t linear = (upper - lower) / num_threads;
+    // Chunks are executed by the persistent pool, no thread is created here
+    ThreadPool::instance().parallel_for(ThreadPool::resolve_threads(num_threads), lower, upper, run_parallel_for_body<int32_t>, &body);
+}
+
+void anydsl_parallel_for_i64(int32_t num_threads, int64_t lower, int64_t upper, void* args, void* fun) {
+    ParallelForBody<int64_t> body = { reinterpret_cast<void (*) (void*, int64_t, int64_t)>(fun), args };
+    ThreadPool::instance().parallel_for(ThreadPool::resolve_threads(num_threads), lower, upper, run_parallel_for_body<int64_t>, &body);
+}
+
+void anydsl_set_numa(bool enable) {
+    ThreadPool::instance().set_numa(enable);
+}
 
-    // Create a pool of threads to execute the task
-    std::vector<std::thread> pool(num_threads);
+void anydsl_parallel_for_sched(int32_t num_threads, int32_t lower, int32_t upper, int32_t grain, int32_t policy, void* args, void* fun) {
+    ParallelForBody<int32_t> body = { reinterpret_cast<void (*) (void*, int32_t, int32_t)>(fun), args };
+    ThreadPool::instance().parallel_for(ThreadPool::resolve_threads(num_threads), lower, upper, grain, Schedule(policy), run_parallel_for_body<int32_t>, &body);
+}
 
-    for (int i = 0, a = lower, b = lower + linear; i < num_threads - 1; a = b, b += linear, i++) {
-        pool[i] = std::thread([=]() {
-            fun_ptr(args, a, b);
-        });
+void anydsl_parallel_for_device(int32_t mask, int32_t num_threads, int32_t lower, int32_t upper, void* args, void* fun) {
+    int32_t node = host_node(mask);
+    if (node < 0) {
+        anydsl_parallel_for(num_threads, lower, upper, args, fun);
+        return;
     }
+    ParallelForBody<int32_t> body = { reinterpret_cast<void (*) (void*, int32_t, int32_t)>(fun), args };
+    ThreadPool::instance().parallel_for_node(size_t(node), num_threads, lower, upper, run_parallel_for_body<int32_t>, &body);
+}
 
-    pool[num_threads - 1] = std::thread([=]() {
-        fun_ptr(args, lower + (num_threads - 1) * linear, upper);
-    });
+struct ReduceBlocks {
+    const ParallelReduce* reduce;
+    char* accs;
+    size_t stride;
+    int64_t lower;
+    int64_t linear;
+    int64_t remainder;
+};
 
-    // Wait for all the threads to finish
-    for (int i = 0; i < num_threads; i++)
-        pool[i].join();
+static void run_reduce_blocks(void* data, int64_t begin, int64_t end) {
+    auto blocks = static_cast<ReduceBlocks*>(data);
+    for (int64_t i = begin; i < end; ++i) {
+        int64_t first = blocks->lower + i * blocks->linear + std::min(i, blocks->remainder);
+        int64_t last  = first + blocks->linear + (i < blocks->remainder ? 1 : 0);
+        blocks->reduce->body(blocks->reduce->args, int32_t(first), int32_t(last), blocks->accs + i * blocks->stride);
+    }
 }
 
-int32_t anydsl_spawn_thread(void* args, void* fun) {
-    std::lock_guard<std::mutex> lock(thread_lock);
+void anydsl_parallel_reduce(int32_t num_threads, int32_t lower, int32_t upper, void* value, int32_t elem_size, void* args, void* body, void* combine) {
+    if (upper <= lower)
+        return;
+    ParallelReduce reduce(value, elem_size, args, body, combine);
 
-    int32_t (*fun_ptr) (void*) = reinterpret_cast<int32_t (*) (void*)>(fun);
+    // One accumulator per block, each on its own cache line
+    int64_t num_blocks = std::min<int64_t>(ThreadPool::resolve_threads(num_threads), upper - lower);
+    size_t stride = (size_t(elem_size) + 63) & ~size_t(63);
+    char* accs = static_cast<char*>(Runtime::aligned_malloc(stride * num_blocks, 64));
+    for (int64_t i = 0; i < num_blocks; ++i)
+        std::memcpy(accs + i * stride, value, elem_size);
 
-    int32_t id;
-    if (free_ids.size()) {
-        id = free_ids.back();
-        free_ids.pop_back();
-    } else {
-        id = static_cast<int32_t>(thread_pool.size());
+    ReduceBlocks blocks = { &reduce, accs, stride, lower, (upper - lower) / num_blocks, (upper - lower) % num_blocks };
+    ThreadPool::instance().parallel_for(int32_t(num_blocks), 0, num_blocks, run_reduce_blocks, &blocks);
+
+    // Combine the blocks pairwise, in a fixed order
+    for (int64_t step = 1; step < num_blocks; step *= 2) {
+        for (int64_t i = 0; i + step < num_blocks; i += 2 * step)
+            reduce.combine(args, accs + i * stride, accs + (i + step) * stride);
     }
+    std::memcpy(value, accs, elem_size);
+    Runtime::aligned_free(accs);
+}
+#else // TBB version
+// Parallel loops run on the TBB workers, which use all the hardware threads. Futures, spawned tasks,
+// streams and large copies still run on the thread pool: its tasks mostly wait, are bound by memory
+// bandwidth, or call parallel loops that run on TBB. The pool is thus limited to a quarter of the
+// hardware threads, which bounds the threads competing for the cores to 1.25 times their number.
+// Spawned tasks and futures still get a worker each beyond that limit, as they may wait on each other.
+static const bool pool_limited = [] {
+    ThreadPool::set_worker_limit(std::max(1, ThreadPool::resolve_threads(0) / 4));
+    return true;
+}();
 
-    auto spawned = std::make_pair(id, std::thread([=](){ fun_ptr(args); }));
-    thread_pool.emplace(std::move(spawned));
-    return id;
+static std::atomic<bool> numa_mode(false);
+
+// In NUMA mode, TBB worker threads are pinned to a core whenever they enter an arena
+class NumaObserver : public tbb::task_scheduler_observer {
+public:
+    NumaObserver() {}
+    NumaObserver(tbb::task_arena& arena) : tbb::task_scheduler_observer(arena) {}
+
+    void on_scheduler_entry(bool is_worker) override {
+        if (!is_worker)
+            return;
+        auto& cpus = numa_cpus();
+        pin_current_thread(numa_mode ? cpus[tbb::this_task_arena::current_thread_index() % cpus.size()] : -1);
+    }
+};
+
+// Arenas are expensive to create, so they are cached per concurrency level
+struct TaskArena {
+    tbb::task_arena arena;
+    NumaObserver observer;
+
+    TaskArena(int32_t num_threads)
+        : arena(num_threads), observer(arena)
+    {}
+};
+
+static std::unordered_map<int32_t, std::unique_ptr<TaskArena>> task_arenas;
+static std::unique_ptr<NumaObserver> default_observer;
+static std::mutex arena_lock;
+
+static tbb::task_arena& get_task_arena(int32_t num_threads) {
+    std::lock_guard<std::mutex> lock(arena_lock);
+    auto& arena = task_arenas[num_threads];
+    if (!arena) {
+        arena.reset(new TaskArena(num_threads));
+        if (numa_mode || default_observer)
+            arena->observer.observe(true);
+    }
+    return arena->arena;
 }
 
-void anydsl_sync_thread(int32_t id) {
-    auto thread = thread_pool.end();
-    {
-        std::lock_guard<std::mutex> lock(thread_lock);
-        thread = thread_pool.find(id);
+void anydsl_set_numa(bool enable) {
+    std::lock_guard<std::mutex> lock(arena_lock);
+    numa_mode = enable;
+    // Once enabled, observers stay active so that disabling NUMA mode unpins the threads again
+    if (!default_observer) {
+        default_observer.reset(new NumaObserver());
+        default_observer->observe(true);
+        for (auto& arena : task_arenas)
+            arena.second->observer.observe(true);
     }
-    if (thread != thread_pool.end()) {
-        thread->second.join();
-        {
-            std::lock_guard<std::mutex> lock(thread_lock);
-            free_ids.push_back(thread->first);
-            thread_pool.erase(thread);
+}
+
+static void init_numa_mode() {
+    static std::once_flag flag;
+    std::call_once(flag, [] {
+        if (numa_enabled_by_env())
+            anydsl_set_numa(true);
+    });
+}
+
+// Number of loop bodies currently executed by this thread
+static thread_local int32_t parallel_depth = 0;
+
+template <typename F>
+static void tbb_execute(int32_t num_threads, F&& f) {
+    // The default arena already uses all the hardware threads, and nested
+    // loops run in the arena of the enclosing loop to avoid oversubscription
+    if (num_threads == 0 || parallel_depth > 0)
+        f();
+    else
+        get_task_arena(num_threads).execute(f);
+}
+
+template <typename Index, typename Partitioner>
+static void tbb_parallel_for(int32_t num_threads, Index lower, Index upper, Index grain, void* args, void* fun, Partitioner&& partitioner) {
+    void (*fun_ptr) (void*, Index, Index) = reinterpret_cast<void (*) (void*, Index, Index)>(fun);
+
+    auto loop = [&] {
+        tbb::parallel_for(tbb::blocked_range<Index>(lower, upper, grain),
+            [=] (const tbb::blocked_range<Index>& range) {
+                ScratchArena::Scope scratch_scope(scratch_arena);
+                parallel_depth++;
+                fun_ptr(args, range.begin(), range.end());
+                parallel_depth--;
+            }, partitioner);
+    };
+
+    tbb_execute(num_threads, loop);
+}
+
+// Affinity partitioners replay the previous assignment of sub-ranges to threads. Every thread keeps
+// those of its most recently used loops, keyed on the arena, its concurrency and the range of the loop.
+class AffinityCache {
+public:
+    typedef std::tuple<const void*, int32_t, int64_t, int64_t> Key;
+
+    tbb::affinity_partitioner& get(const Key& key) {
+        auto it = index_.find(key);
+        if (it != index_.end()) {
+            entries_.splice(entries_.begin(), entries_, it->second);
+            return it->second->second;
         }
-    } else {
-        assert(0 && "Trying to synchronize on invalid thread id");
+        // Only called outside of loop bodies: the evicted partitioner is not in use
+        if (entries_.size() >= capacity) {
+            index_.erase(entries_.back().first);
+            entries_.pop_back();
+        }
+        entries_.emplace_front(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple());
+        index_.emplace(key, entries_.begin());
+        return entries_.front().second;
     }
+
+private:
+    static constexpr size_t capacity = 64;
+
+    std::list<std::pair<Key, tbb::affinity_partitioner>> entries_; ///< Most recently used first
+    std::map<Key, std::list<std::pair<Key, tbb::affinity_partitioner>>::iterator> index_;
+};
+
+static tbb::affinity_partitioner& affinity_partitioner(int32_t num_threads, int64_t lower, int64_t upper) {
+    static thread_local AffinityCache cache;
+    // Loops with num_threads == 0 run in the arena of the caller
+    const void* arena = num_threads == 0 ? nullptr : &get_task_arena(num_threads);
+    int32_t concurrency = num_threads == 0 ? tbb::this_task_arena::max_concurrency() : num_threads;
+    return cache.get(AffinityCache::Key(arena, concurrency, lower, upper));
 }
-#else // TBB version
+
+// Nested loops would evict partitioners still used by the enclosing loop on the same thread,
+// and their sub-ranges are not repeated anyway: they use the auto partitioner
+static bool use_affinity() {
+    return numa_mode && parallel_depth == 0;
+}
+
 void anydsl_parallel_for(int32_t num_threads, int32_t lower, int32_t upper, void* args, void* fun) {
-    tbb::task_arena limited((num_threads == 0) ? tbb::task_arena::automatic : num_threads);
-    tbb::task_group tg;
+    init_numa_mode();
+    if (use_affinity())
+        tbb_parallel_for(num_threads, lower, upper, 1, args, fun, affinity_partitioner(num_threads, lower, upper));
+    else
+        tbb_parallel_for(num_threads, lower, upper, 1, args, fun, tbb::auto_partitioner());
+}
+
+void anydsl_parallel_for_i64(int32_t num_threads, int64_t lower, int64_t upper, void* args, void* fun) {
+    init_numa_mode();
+    if (use_affinity())
+        tbb_parallel_for<int64_t>(num_threads, lower, upper, 1, args, fun, affinity_partitioner(num_threads, lower, upper));
+    else
+        tbb_parallel_for<int64_t>(num_threads, lower, upper, 1, args, fun, tbb::auto_partitioner());
+}
+
+void anydsl_parallel_for_sched(int32_t num_threads, int32_t lower, int32_t upper, int32_t grain, int32_t policy, void* args, void* fun) {
+    grain = grain > 0 ? grain : 1;
+    switch (policy) {
+        case ANYDSL_SCHEDULE_STATIC:  tbb_parallel_for(num_threads, lower, upper, grain, args, fun, tbb::static_partitioner()); break;
+        case ANYDSL_SCHEDULE_DYNAMIC: tbb_parallel_for(num_threads, lower, upper, grain, args, fun, tbb::simple_partitioner()); break;
+        default:                      tbb_parallel_for(num_threads, lower, upper, grain, args, fun, tbb::auto_partitioner()); break;
+    }
+}
+
+void anydsl_parallel_for_device(int32_t mask, int32_t num_threads, int32_t lower, int32_t upper, void* args, void* fun) {
+    int32_t node = host_node(mask);
+    if (node < 0) {
+        anydsl_parallel_for(num_threads, lower, upper, args, fun);
+        return;
+    }
+    if (upper <= lower)
+        return;
 
+    // One chunk per CPU of the node, the threads running a chunk are moved to the node meanwhile
     void (*fun_ptr) (void*, int32_t, int32_t) = reinterpret_cast<void (*) (void*, int32_t, int32_t)>(fun);
+    int32_t num_chunks = num_threads > 0 ? num_threads : int32_t(numa_nodes()[node].cpus.size());
+    int32_t grain = std::max(1, (upper - lower + num_chunks - 1) / num_chunks);
+    tbb_execute(num_threads, [&] {
+        tbb::parallel_for(tbb::blocked_range<int32_t>(lower, upper, grain),
+            [=] (const tbb::blocked_range<int32_t>& range) {
+                ScratchArena::Scope scratch_scope(scratch_arena);
+                bind_current_thread(size_t(node));
+                parallel_depth++;
+                fun_ptr(args, range.begin(), range.end());
+                parallel_depth--;
+                unbind_current_thread();
+            }, tbb::static_partitioner());
+    });
+}
+
+class ReduceBody {
+public:
+    ReduceBody(const ParallelReduce& reduce)
+        : reduce_(reduce), acc_(reduce.new_accumulator())
+    {}
+
+    ReduceBody(ReduceBody& other, tbb::split)
+        : ReduceBody(other.reduce_)
+    {}
 
-    limited.execute([&] {
-        tg.run([&] {
-            tbb::parallel_for(tbb::blocked_range<int32_t>(lower, upper),
-                [=] (const tbb::blocked_range<int32_t>& range) {
-                    fun_ptr(args, range.begin(), range.end());
-                });
-        });
+    ~ReduceBody() { Runtime::aligned_free(acc_); }
+
+    void operator () (const tbb::blocked_range<int32_t>& range) {
+        parallel_depth++;
+        reduce_.body(reduce_.args, range.begin(), range.end(), acc_);
+        parallel_depth--;
+    }
+
+    void join(ReduceBody& rhs) { reduce_.combine(reduce_.args, acc_, rhs.acc_); }
+
+    const void* value() const { return acc_; }
+
+private:
+    const ParallelReduce& reduce_;
+    void* acc_;
+};
+
+void anydsl_parallel_reduce(int32_t num_threads, int32_t lower, int32_t upper, void* value, int32_t elem_size, void* args, void* body, void* combine) {
+    if (upper <= lower)
+        return;
+    ParallelReduce reduce(value, elem_size, args, body, combine);
+
+    // The grain size only depends on the number of threads, which makes the reduction tree deterministic
+    int32_t num_blocks = num_threads == 0 ? tbb::this_task_arena::max_concurrency() : num_threads;
+    int32_t grain = std::max(1, (upper - lower + num_blocks - 1) / num_blocks);
+    ReduceBody reduce_body(reduce);
+    tbb_execute(num_threads, [&] {
+        tbb::parallel_deterministic_reduce(tbb::blocked_range<int32_t>(lower, upper, grain), reduce_body, tbb::simple_partitioner());
     });
+    std::memcpy(value, reduce_body.value(), elem_size);
+}
+#endif
+
+// Tiled loops: tiles are numbered along a Z-order (Morton) curve, so that the
+// consecutive tile indices that a thread processes form a compact block.
+// Grids whose Morton codes do not fit in 63 bits number their tiles in row-major order.
+template <int N>
+struct TiledLoop {
+    int32_t lower[N];
+    int32_t upper[N];
+    int32_t tile[N];
+    int64_t num_tiles[N];
+    int32_t bits[N];
+    bool morton;
+    int64_t num_codes;       ///< Codes past the last tile are not scheduled
+    int64_t codes_per_block; ///< Codes are scheduled in blocks, so that their number fits in 32 bits
+    void* args;
+    void* fun;
+};
+
+static int32_t ceil_log2(int64_t n) {
+    int32_t bits = 0;
+    while (bits < 63 && (int64_t(1) << bits) < n) bits++;
+    return bits;
+}
+
+template <int N>
+static int64_t encode_tile(const TiledLoop<N>& loop, const int64_t (&coords)[N]) {
+    int64_t code = 0;
+    int32_t pos = 0;
+    for (int32_t level = 0; pos < 63; ++level) {
+        bool done = true;
+        for (int d = 0; d < N; ++d) {
+            if (level < loop.bits[d]) {
+                code |= ((coords[d] >> level) & 1) << pos++;
+                done = false;
+            }
+        }
+        if (done)
+            break;
+    }
+    return code;
+}
 
-    limited.execute([&] { tg.wait(); });
+// Decodes a Morton code into tile coordinates. Dimensions that have fewer bits stop
+// taking part in the interleaving, which keeps the code space below 2^N times the tile count.
+template <int N>
+static bool decode_tile(const TiledLoop<N>& loop, int64_t code, int64_t (&coords)[N]) {
+    if (!loop.morton) {
+        for (int d = N - 1; d >= 0; --d) {
+            coords[d] = code % loop.num_tiles[d];
+            code /= loop.num_tiles[d];
+        }
+        return true;
+    }
+    for (int d = 0; d < N; ++d)
+        coords[d] = 0;
+    for (int32_t level = 0; code != 0; ++level) {
+        for (int d = 0; d < N; ++d) {
+            if (level < loop.bits[d]) {
+                coords[d] |= (code & 1) << level;
+                code >>= 1;
+            }
+        }
+    }
+    for (int d = 0; d < N; ++d) {
+        if (coords[d] >= loop.num_tiles[d])
+            return false;
+    }
+    return true;
 }
 
-typedef tbb::concurrent_unordered_map<int32_t, tbb::task_group, std::hash<int32_t>> task_group_map;
-typedef std::pair<task_group_map::iterator, bool> task_group_node_ref;
-static task_group_map task_pool;
-static tbb::concurrent_queue<int32_t> free_ids;
-static std::mutex thread_lock;
+// Returns the code that follows the largest aligned block of codes that contains `code`,
+// but no tile: along the dimension past the grid, all the coordinates of the block are too large.
+template <int N>
+static int64_t skip_empty_block(const TiledLoop<N>& loop, int64_t code, const int64_t (&coords)[N]) {
+    int32_t level = 0;
+    for (int d = 0; d < N; ++d) {
+        if (coords[d] < loop.num_tiles[d])
+            continue;
+        int32_t l = 0;
+        while (l < loop.bits[d] && ((coords[d] >> (l + 1)) << (l + 1)) >= loop.num_tiles[d])
+            l++;
+        level = std::max(level, l);
+    }
+    // The levels below `level` occupy the lowest bits of the code
+    int32_t pos = 0;
+    for (int d = 0; d < N; ++d)
+        pos += std::min(loop.bits[d], level);
+    return ((code >> pos) + 1) << pos;
+}
 
-int32_t anydsl_spawn_thread(void* args, void* fun) {
-    std::lock_guard<std::mutex> lock(thread_lock);
-    int32_t id = -1;
-    if (!free_ids.try_pop(id)) {
-        id = int32_t(task_pool.size());
+template <int N>
+static void run_tiles(void* data, int32_t begin, int32_t end) {
+    auto& loop = *static_cast<TiledLoop<N>*>(data);
+    int64_t last = std::min(int64_t(end) * loop.codes_per_block, loop.num_codes);
+    for (int64_t code = int64_t(begin) * loop.codes_per_block, next; code < last; code = next) {
+        int64_t coords[N];
+        if (!decode_tile(loop, code, coords)) {
+            next = skip_empty_block(loop, code, coords);
+            continue;
+        }
+        next = code + 1;
+        int32_t lo[N], hi[N];
+        for (int d = 0; d < N; ++d) {
+            int64_t first = loop.lower[d] + coords[d] * loop.tile[d];
+            lo[d] = int32_t(first);
+            hi[d] = int32_t(std::min<int64_t>(first + loop.tile[d], loop.upper[d]));
+        }
+        if constexpr (N == 2)
+            reinterpret_cast<void (*) (void*, int32_t, int32_t, int32_t, int32_t)>(loop.fun)(loop.args, lo[0], hi[0], lo[1], hi[1]);
+        else
+            reinterpret_cast<void (*) (void*, int32_t, int32_t, int32_t, int32_t, int32_t, int32_t)>(loop.fun)(loop.args, lo[0], hi[0], lo[1], hi[1], lo[2], hi[2]);
     }
+}
 
-    int32_t(*fun_ptr) (void*) = reinterpret_cast<int32_t(*)(void*)>(fun);
+template <int N>
+static void parallel_for_tiled(int32_t num_threads, TiledLoop<N>& loop) {
+    int32_t total_bits = 0;
+    for (int d = 0; d < N; ++d) {
+        if (loop.upper[d] <= loop.lower[d])
+            return;
+        loop.tile[d] = std::max(loop.tile[d], 1);
+        loop.num_tiles[d] = (int64_t(loop.upper[d]) - loop.lower[d] + loop.tile[d] - 1) / loop.tile[d];
+        loop.bits[d] = ceil_log2(loop.num_tiles[d]);
+        total_bits += loop.bits[d];
+    }
 
-    assert(id >= 0);
+    loop.morton = total_bits <= 62;
+    if (loop.morton) {
+        // Morton codes grow with every coordinate: the code of the last tile bounds the code space
+        int64_t last[N];
+        for (int d = 0; d < N; ++d)
+            last[d] = loop.num_tiles[d] - 1;
+        loop.num_codes = encode_tile(loop, last) + 1;
+    } else {
+        loop.num_codes = 1;
+        for (int d = 0; d < N; ++d) {
+            if (loop.num_tiles[d] > INT64_MAX / loop.num_codes)
+                error("Too many tiles in %-dimensional parallel loop", N);
+            loop.num_codes *= loop.num_tiles[d];
+        }
+    }
 
-    task_group_node_ref p = task_pool.emplace(std::piecewise_construct, std::forward_as_tuple(id), std::forward_as_tuple());
-    tbb::task_group& tg = p.first->second;
+    const int64_t max_blocks = int64_t(1) << 30;
+    loop.codes_per_block = (loop.num_codes + max_blocks - 1) / max_blocks;
+    int32_t num_blocks = int32_t((loop.num_codes + loop.codes_per_block - 1) / loop.codes_per_block);
+    anydsl_parallel_for_sched(num_threads, 0, num_blocks, 0, ANYDSL_SCHEDULE_DYNAMIC, &loop, reinterpret_cast<void*>(run_tiles<N>));
+}
 
-    tg.run([=] { fun_ptr(args); });
+void anydsl_parallel_for_2d(
+    int32_t num_threads,
+    int32_t lower_x, int32_t upper_x, int32_t lower_y, int32_t upper_y,
+    int32_t tile_x, int32_t tile_y,
+    void* args, void* fun) {
+    TiledLoop<2> loop = { { lower_x, lower_y }, { upper_x, upper_y }, { tile_x, tile_y }, {}, {}, false, 0, 0, args, fun };
+    parallel_for_tiled(num_threads, loop);
+}
 
-    return id;
+void anydsl_parallel_for_3d(
+    int32_t num_threads,
+    int32_t lower_x, int32_t upper_x, int32_t lower_y, int32_t upper_y, int32_t lower_z, int32_t upper_z,
+    int32_t tile_x, int32_t tile_y, int32_t tile_z,
+    void* args, void* fun) {
+    TiledLoop<3> loop = { { lower_x, lower_y, lower_z }, { upper_x, upper_y, upper_z }, { tile_x, tile_y, tile_z }, {}, {}, false, 0, 0, args, fun };
+    parallel_for_tiled(num_threads, loop);
 }
 
-void anydsl_sync_thread(int32_t id) {
-    auto task = task_pool.end();
+// Task graphs: every task counts its remaining predecessors,
+// and is handed over to the scheduler once that counter reaches zero.
+// The ids of destroyed graphs and of their tasks are reused by later graphs and tasks.
+struct GraphTask {
+    Closure closure;
+    int32_t graph;                  ///< Owning graph, or -1 once the graph has been destroyed
+    int32_t num_preds;
+    std::atomic<int32_t> remaining;
+    std::vector<GraphTask*> succs;
+    void* exec;
+
+    GraphTask(int32_t graph, Closure closure)
+        : remaining(0)
     {
-        std::lock_guard<std::mutex> lock(thread_lock);
-        task = task_pool.find(id);
+        reset(graph, closure);
     }
-    if (task != task_pool.end()) {
-        task->second.wait();
-        {
-            std::lock_guard<std::mutex> lock(thread_lock);
-            free_ids.push(task->first);
-        }
+
+    void reset(int32_t graph, Closure closure) {
+        this->closure = closure;
+        this->graph = graph;
+        num_preds = 0;
+        succs.clear();
+        exec = nullptr;
+    }
+};
+
+struct TaskGraph {
+    std::vector<GraphTask*> tasks;
+    std::vector<int32_t> task_ids;
+    bool alive = true;
+    std::mutex exec_lock;
+};
+
+static std::deque<TaskGraph> task_graphs;
+static std::deque<GraphTask> graph_tasks;
+static std::vector<int32_t> free_graphs;
+static std::vector<int32_t> free_tasks;
+static std::mutex graph_lock;
+
+static bool valid_graph(int32_t graph) {
+    return graph >= 0 && size_t(graph) < task_graphs.size() && task_graphs[graph].alive;
+}
+
+static bool valid_task(int32_t task) {
+    return task >= 0 && size_t(task) < graph_tasks.size() && graph_tasks[task].graph >= 0;
+}
+
+int32_t anydsl_create_graph() {
+    std::lock_guard<std::mutex> lock(graph_lock);
+    if (!free_graphs.empty()) {
+        int32_t graph = free_graphs.back();
+        free_graphs.pop_back();
+        task_graphs[graph].alive = true;
+        return graph;
+    }
+    task_graphs.emplace_back();
+    return int32_t(task_graphs.size() - 1);
+}
+
+int32_t anydsl_create_task(int32_t graph, Closure closure) {
+    std::lock_guard<std::mutex> lock(graph_lock);
+    assert(valid_graph(graph) && "Invalid graph id");
+    int32_t task;
+    if (!free_tasks.empty()) {
+        task = free_tasks.back();
+        free_tasks.pop_back();
+        graph_tasks[task].reset(graph, closure);
     } else {
-        assert(0 && "Trying to synchronize on invalid task id");
+        graph_tasks.emplace_back(graph, closure);
+        task = int32_t(graph_tasks.size() - 1);
+    }
+    task_graphs[graph].tasks.push_back(&graph_tasks[task]);
+    task_graphs[graph].task_ids.push_back(task);
+    return task;
+}
+
+void anydsl_create_edge(int32_t from, int32_t to) {
+    std::lock_guard<std::mutex> lock(graph_lock);
+    assert(valid_task(from) && "Invalid task id");
+    assert(valid_task(to)   && "Invalid task id");
+    assert(graph_tasks[from].graph == graph_tasks[to].graph && "Tasks belong to different graphs");
+    graph_tasks[from].succs.push_back(&graph_tasks[to]);
+    graph_tasks[to].num_preds++;
+}
+
+#ifndef AnyDSL_runtime_HAS_TBB_SUPPORT
+static void run_graph_task(void* data, int64_t, int64_t) {
+    auto task = static_cast<GraphTask*>(data);
+    task->closure.fn(task->closure.payload);
+    auto group = static_cast<TaskGroup*>(task->exec);
+    for (auto succ : task->succs) {
+        if (succ->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            ThreadPool::instance().submit(*group, run_graph_task, succ, 0, 0);
     }
 }
+
+static void execute_graph(const std::vector<GraphTask*>& tasks, const std::vector<GraphTask*>& roots) {
+    TaskGroup group;
+    auto& pool = ThreadPool::instance();
+    for (auto task : tasks)
+        task->exec = &group;
+    for (auto root : roots)
+        pool.submit(group, run_graph_task, root, 0, 0);
+    pool.wait(group);
+}
+#else
+static void run_graph_task(GraphTask* task) {
+    task->closure.fn(task->closure.payload);
+    auto group = static_cast<tbb::task_group*>(task->exec);
+    for (auto succ : task->succs) {
+        if (succ->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            group->run([=] { run_graph_task(succ); });
+    }
+}
+
+static void execute_graph(const std::vector<GraphTask*>& tasks, const std::vector<GraphTask*>& roots) {
+    tbb::task_group group;
+    for (auto task : tasks)
+        task->exec = &group;
+    for (auto root : roots)
+        group.run([=] { run_graph_task(root); });
+    group.wait();
+}
 #endif
+
+// Runs all the tasks of the graph, starting with the tasks that have no predecessors. A task
+// that is given as `root` must be the only such task: the whole graph is then reachable from it.
+void anydsl_execute_graph(int32_t graph, int32_t root) {
+    TaskGraph* task_graph = nullptr;
+    std::vector<GraphTask*> tasks, roots;
+    {
+        std::lock_guard<std::mutex> lock(graph_lock);
+        assert(valid_graph(graph) && "Invalid graph id");
+        assert((root < 0 || (valid_task(root) && graph_tasks[root].graph == graph)) && "Invalid root task id");
+        task_graph = &task_graphs[graph];
+        tasks = task_graph->tasks;
+    }
+
+    // A graph can be executed several times, but only one execution may be in flight at a time
+    std::lock_guard<std::mutex> lock(task_graph->exec_lock);
+    for (auto task : tasks) {
+        task->remaining.store(task->num_preds, std::memory_order_relaxed);
+        if (task->num_preds == 0)
+            roots.push_back(task);
+    }
+    if (root >= 0 && (roots.size() != 1 || roots[0] != &graph_tasks[root]))
+        error("Task % is not the only task without predecessors in graph %", root, graph);
+    execute_graph(tasks, roots);
+}
+
+void anydsl_destroy_graph(int32_t graph) {
+    TaskGraph* task_graph_ptr = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(graph_lock);
+        assert(valid_graph(graph) && "Invalid graph id");
+        task_graph_ptr = &task_graphs[graph];
+    }
+
+    // Wait for an execution that may still be in flight, without holding the graph lock,
+    // so that the tasks of that execution can still create graphs or tasks
+    std::lock_guard<std::mutex> exec_lock(task_graph_ptr->exec_lock);
+    std::lock_guard<std::mutex> lock(graph_lock);
+    TaskGraph& task_graph = *task_graph_ptr;
+    for (auto task : task_graph.task_ids) {
+        graph_tasks[task].reset(-1, Closure { nullptr, 0 });
+        free_tasks.push_back(task);
+    }
+    task_graph.tasks.clear();
+    task_graph.task_ids.clear();
+    task_graph.alive = false;
+    free_graphs.push_back(graph);
+}
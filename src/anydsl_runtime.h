@@ -11,6 +11,8 @@ extern "C" {
 #endif
 
 #define ANYDSL_DEVICE(p, d) ((p) | ((d) << 4))
+// Host device of a NUMA node, host device 0 is the whole machine
+#define ANYDSL_HOST_NODE(n) ANYDSL_DEVICE(ANYDSL_HOST, (n) + 1)
 
 enum {
     ANYDSL_HOST = 0,
@@ -33,8 +35,78 @@ AnyDSL_runtime_API void* anydsl_get_device_ptr(int32_t, void*);
 AnyDSL_runtime_API void  anydsl_release(int32_t, void*);
 AnyDSL_runtime_API void  anydsl_release_host(int32_t, void*);
 
+enum {
+    ANYDSL_ALLOC_DEVICE = 0,         // Memory like anydsl_alloc, released with anydsl_release
+    ANYDSL_ALLOC_HOST = 1,           // Memory like anydsl_alloc_host, released with anydsl_release_host
+    ANYDSL_ALLOC_UNIFIED = 2,        // Memory like anydsl_alloc_unified, released with anydsl_release
+    ANYDSL_ALLOC_KIND_MASK = 3,
+    ANYDSL_ALLOC_HUGE_PAGES = 1 << 4 // Back the memory with huge pages if possible
+};
+
+enum {
+    ANYDSL_PAGES_DEFAULT = 0,        // Regular pages
+    ANYDSL_PAGES_TRANSPARENT = 1,    // Transparent huge pages, used by the kernel when the memory is touched
+    ANYDSL_PAGES_HUGETLB = 2         // Huge pages reserved by the system
+};
+
+AnyDSL_runtime_API void*   anydsl_alloc_ex(int32_t, int64_t, int32_t);
+AnyDSL_runtime_API int32_t anydsl_page_kind(int32_t, void*);
+
+// Memory allocated through the runtime on a device, only tracked with ANYDSL_TRACK_ALLOC=1
+struct AnyDSL_runtime_API MemoryStats {
+    int64_t live_bytes;
+    int64_t peak_bytes;
+    int64_t live_allocs;
+    int64_t total_allocs;
+};
+
+AnyDSL_runtime_API bool anydsl_memory_stats(int32_t, struct MemoryStats*);
+
+enum {
+    ANYDSL_MAP_READ_ONLY = 0,        // Read-only mapping of the file
+    ANYDSL_MAP_PRIVATE = 1 << 0,     // Writable mapping, changes stay private to the process and never reach the file
+    ANYDSL_MAP_POPULATE = 1 << 1,    // Read the whole range when mapping it, rather than on first access
+    ANYDSL_MAP_SEQUENTIAL = 1 << 2,  // The range is mostly read in order (MADV_SEQUENTIAL)
+    ANYDSL_MAP_WILLNEED = 1 << 3     // The range is needed soon, start reading it ahead (MADV_WILLNEED)
+};
+
+// Arenas serve allocations from a single buffer of the device until they are reset.
+// Alignments are relative to the start of the arena, allocations return NULL once it is full.
+AnyDSL_runtime_API int32_t anydsl_arena_create(int32_t, int64_t);
+AnyDSL_runtime_API void*   anydsl_arena_alloc(int32_t, int64_t, int64_t);
+AnyDSL_runtime_API void    anydsl_arena_reset(int32_t);
+AnyDSL_runtime_API void    anydsl_arena_destroy(int32_t);
+
+AnyDSL_runtime_API void*   anydsl_map_file(int32_t, const char*, int64_t, int64_t, int32_t);
+AnyDSL_runtime_API void    anydsl_unmap(int32_t, void*);
+AnyDSL_runtime_API int64_t anydsl_file_size(const char*);
+
+struct AnyDSL_runtime_API AllocCacheStats {
+    int64_t hits;
+    int64_t misses;
+    int64_t retained;
+    int64_t limit;
+};
+
+AnyDSL_runtime_API void anydsl_trim();
+AnyDSL_runtime_API void anydsl_set_alloc_cache_limit(int64_t);
+AnyDSL_runtime_API void anydsl_alloc_cache_stats(struct AllocCacheStats*);
+
 AnyDSL_runtime_API void anydsl_copy(int32_t, const void*, int64_t, int32_t, void*, int64_t, int64_t);
 
+// Streams run their operations in order, asynchronously with the host. The stream of a copy must be
+// created on the device that performs it: the source, unless only the destination is not on the host.
+// The memory of a copy must stay valid until the copy has completed. Waiting for an event releases it.
+// anydsl_device_wait_event makes the kernels launched afterwards on the device of the event wait for it,
+// without blocking the host: the event must still be waited for to release it.
+AnyDSL_runtime_API int32_t anydsl_stream_create(int32_t);
+AnyDSL_runtime_API void    anydsl_stream_destroy(int32_t);
+AnyDSL_runtime_API void    anydsl_stream_synchronize(int32_t);
+AnyDSL_runtime_API void    anydsl_copy_async(int32_t, const void*, int64_t, int32_t, void*, int64_t, int64_t, int32_t);
+AnyDSL_runtime_API int32_t anydsl_event_record(int32_t);
+AnyDSL_runtime_API void    anydsl_event_wait(int32_t);
+AnyDSL_runtime_API void    anydsl_device_wait_event(int32_t);
+
 AnyDSL_runtime_API void anydsl_launch_kernel(
     int32_t, const char*, const char*,
     const uint32_t*, const uint32_t*,
@@ -45,6 +117,7 @@ AnyDSL_runtime_API void anydsl_synchronize(int32_t);
 AnyDSL_runtime_API void anydsl_random_seed(uint32_t);
 AnyDSL_runtime_API float    anydsl_random_val_f32();
 AnyDSL_runtime_API uint64_t anydsl_random_val_u64();
+AnyDSL_runtime_API void     anydsl_random_fill_f32(float*, int64_t, uint64_t, uint64_t);
 
 AnyDSL_runtime_API uint64_t anydsl_get_micro_time();
 AnyDSL_runtime_API uint64_t anydsl_get_nano_time();
@@ -72,9 +145,68 @@ AnyDSL_runtime_API void anydsl_print_flush();
 AnyDSL_runtime_API void* anydsl_aligned_malloc(size_t, size_t);
 AnyDSL_runtime_API void anydsl_aligned_free(void*);
 
+enum {
+    ANYDSL_SCHEDULE_STATIC = 0,
+    ANYDSL_SCHEDULE_DYNAMIC = 1,
+    ANYDSL_SCHEDULE_GUIDED = 2
+};
+
 AnyDSL_runtime_API void anydsl_parallel_for(int32_t, int32_t, int32_t, void*, void*);
+AnyDSL_runtime_API void anydsl_parallel_for_i64(int32_t, int64_t, int64_t, void*, void*);
+AnyDSL_runtime_API void anydsl_parallel_for_sched(int32_t, int32_t, int32_t, int32_t, int32_t, void*, void*);
+AnyDSL_runtime_API void anydsl_set_numa(bool);
+AnyDSL_runtime_API int32_t anydsl_numa_node_count(void);
+AnyDSL_runtime_API void anydsl_parallel_for_device(int32_t, int32_t, int32_t, int32_t, void*, void*);
+AnyDSL_runtime_API bool anydsl_bind_thread(int32_t);
+AnyDSL_runtime_API void anydsl_unbind_thread(int32_t);
+AnyDSL_runtime_API void anydsl_parallel_for_2d(int32_t, int32_t, int32_t, int32_t, int32_t, int32_t, int32_t, void*, void*);
+AnyDSL_runtime_API void anydsl_parallel_for_3d(int32_t, int32_t, int32_t, int32_t, int32_t, int32_t, int32_t, int32_t, int32_t, int32_t, void*, void*);
+AnyDSL_runtime_API void* anydsl_thread_scratch(int64_t);
+AnyDSL_runtime_API void  anydsl_thread_scratch_reset();
+AnyDSL_runtime_API void anydsl_parallel_reduce(int32_t, int32_t, int32_t, void*, int32_t, void*, void*, void*);
+AnyDSL_runtime_API void anydsl_scan_i32(int32_t, const int32_t*, int32_t*, int64_t, bool);
+AnyDSL_runtime_API void anydsl_scan_i64(int32_t, const int64_t*, int64_t*, int64_t, bool);
+AnyDSL_runtime_API void anydsl_scan_f32(int32_t, const float*, float*, int64_t, bool);
+AnyDSL_runtime_API int32_t anydsl_compact(int32_t, const int32_t*, int32_t*, int32_t);
 AnyDSL_runtime_API int32_t anydsl_spawn_thread(void*, void*);
 AnyDSL_runtime_API void anydsl_sync_thread(int32_t);
+AnyDSL_runtime_API int32_t anydsl_async(void*, void*);
+AnyDSL_runtime_API int32_t anydsl_then(int32_t, void*, void*);
+AnyDSL_runtime_API void    anydsl_then_next(int32_t);
+AnyDSL_runtime_API int32_t anydsl_when_all(const int32_t*, int32_t);
+AnyDSL_runtime_API void    anydsl_wait(int32_t);
+
+AnyDSL_runtime_API int32_t anydsl_barrier_create(int32_t);
+AnyDSL_runtime_API bool    anydsl_barrier_wait(int32_t);
+AnyDSL_runtime_API void    anydsl_barrier_destroy(int32_t);
+AnyDSL_runtime_API int32_t anydsl_latch_create(int32_t);
+AnyDSL_runtime_API void    anydsl_latch_count_down(int32_t, int32_t);
+AnyDSL_runtime_API bool    anydsl_latch_try_wait(int32_t);
+AnyDSL_runtime_API void    anydsl_latch_wait(int32_t);
+AnyDSL_runtime_API void    anydsl_latch_destroy(int32_t);
+AnyDSL_runtime_API int32_t anydsl_semaphore_create(int32_t);
+AnyDSL_runtime_API bool    anydsl_semaphore_try_acquire(int32_t);
+AnyDSL_runtime_API void    anydsl_semaphore_acquire(int32_t);
+AnyDSL_runtime_API void    anydsl_semaphore_release(int32_t, int32_t);
+AnyDSL_runtime_API void    anydsl_semaphore_destroy(int32_t);
+
+AnyDSL_runtime_API int32_t anydsl_channel_create(int32_t, int32_t);
+AnyDSL_runtime_API void    anydsl_channel_close(int32_t);
+AnyDSL_runtime_API void    anydsl_channel_destroy(int32_t);
+AnyDSL_runtime_API bool    anydsl_channel_try_push(int32_t, const void*);
+AnyDSL_runtime_API bool    anydsl_channel_try_pop(int32_t, void*);
+AnyDSL_runtime_API bool    anydsl_channel_push(int32_t, const void*);
+AnyDSL_runtime_API bool    anydsl_channel_pop(int32_t, void*);
+AnyDSL_runtime_API int32_t anydsl_channel_try_push_batch(int32_t, const void*, int32_t);
+AnyDSL_runtime_API int32_t anydsl_channel_try_pop_batch(int32_t, void*, int32_t);
+AnyDSL_runtime_API int32_t anydsl_channel_push_batch(int32_t, const void*, int32_t);
+AnyDSL_runtime_API int32_t anydsl_channel_pop_batch(int32_t, void*, int32_t);
+
+AnyDSL_runtime_API void    anydsl_pipeline_for(int32_t, int32_t, int32_t, int32_t, void*, void*);
+AnyDSL_runtime_API int32_t anydsl_pipeline_create(int32_t, int32_t);
+AnyDSL_runtime_API void    anydsl_pipeline_begin(int32_t, int32_t, int32_t);
+AnyDSL_runtime_API void    anydsl_pipeline_end(int32_t, int32_t);
+AnyDSL_runtime_API void    anydsl_pipeline_destroy(int32_t);
 
 struct AnyDSL_runtime_API Closure {
     void (*fn)(uint64_t);
@@ -85,6 +217,7 @@ AnyDSL_runtime_API int32_t anydsl_create_graph();
 AnyDSL_runtime_API int32_t anydsl_create_task(int32_t, Closure);
 AnyDSL_runtime_API void    anydsl_create_edge(int32_t, int32_t);
 AnyDSL_runtime_API void    anydsl_execute_graph(int32_t, int32_t);
+AnyDSL_runtime_API void    anydsl_destroy_graph(int32_t);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,220 @@
+#include <algorithm>
+#include <memory>
+#include <thread>
+
+#include "anydsl_runtime.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define ANYDSL_SCAN_SSE2
+#endif
+
+// Parallel prefix sums: the array is split in blocks, the first pass computes the sum
+// of every block, and the second pass scans every block starting from the sum of the
+// preceding blocks. Both passes use all the threads, the block sums are scanned serially.
+
+// Below this number of elements, the scan is performed serially
+static constexpr int64_t serial_scan_size = 1 << 14;
+
+static int64_t scan_blocks(int32_t num_threads, int64_t n) {
+    int64_t num_blocks = num_threads;
+    if (num_blocks <= 0)
+        num_blocks = std::max(1u, std::thread::hardware_concurrency());
+    return std::min(num_blocks, std::max<int64_t>(1, n / serial_scan_size));
+}
+
+// Sums a block with independent partial sums that the compiler can map to vector lanes
+template <typename T>
+static T reduce_block(const T* in, int64_t n) {
+    T lanes[8] = {};
+    int64_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        for (int j = 0; j < 8; ++j)
+            lanes[j] += in[i + j];
+    }
+    T sum = 0;
+    for (; i < n; ++i)
+        sum += in[i];
+    for (int j = 0; j < 8; ++j)
+        sum += lanes[j];
+    return sum;
+}
+
+template <typename T>
+static T scan_block_scalar(const T* in, T* out, int64_t n, T carry, bool exclusive) {
+    for (int64_t i = 0; i < n; ++i) {
+        T value = in[i];
+        out[i] = exclusive ? carry : carry + value;
+        carry += value;
+    }
+    return carry;
+}
+
+// Scans a block into `out`, starting from `carry`, and returns the sum including the block
+template <typename T>
+static T scan_block(const T* in, T* out, int64_t n, T carry, bool exclusive) {
+    return scan_block_scalar(in, out, n, carry, exclusive);
+}
+
+#ifdef ANYDSL_SCAN_SSE2
+// Prefix sums inside a vector are computed with log2(lanes) shifted additions
+template <>
+int32_t scan_block(const int32_t* in, int32_t* out, int64_t n, int32_t carry, bool exclusive) {
+    __m128i sum = _mm_set1_epi32(carry);
+    int64_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+        x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+        __m128i y = exclusive ? _mm_slli_si128(x, 4) : x;
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_add_epi32(y, sum));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(x, _MM_SHUFFLE(3, 3, 3, 3)));
+    }
+    return scan_block_scalar(in + i, out + i, n - i, _mm_cvtsi128_si32(sum), exclusive);
+}
+
+template <>
+int64_t scan_block(const int64_t* in, int64_t* out, int64_t n, int64_t carry, bool exclusive) {
+    __m128i sum = _mm_set1_epi64x(carry);
+    int64_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        x = _mm_add_epi64(x, _mm_slli_si128(x, 8));
+        __m128i y = exclusive ? _mm_slli_si128(x, 8) : x;
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_add_epi64(y, sum));
+        sum = _mm_add_epi64(sum, _mm_unpackhi_epi64(x, x));
+    }
+    int64_t carry_out;
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(&carry_out), sum);
+    return scan_block_scalar(in + i, out + i, n - i, carry_out, exclusive);
+}
+
+template <>
+float scan_block(const float* in, float* out, int64_t n, float carry, bool exclusive) {
+    __m128 sum = _mm_set1_ps(carry);
+    int64_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 x = _mm_loadu_ps(in + i);
+        x = _mm_add_ps(x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 4)));
+        x = _mm_add_ps(x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 8)));
+        __m128 y = exclusive ? _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 4)) : x;
+        _mm_storeu_ps(out + i, _mm_add_ps(y, sum));
+        sum = _mm_add_ps(sum, _mm_shuffle_ps(x, x, _MM_SHUFFLE(3, 3, 3, 3)));
+    }
+    return scan_block_scalar(in + i, out + i, n - i, _mm_cvtss_f32(sum), exclusive);
+}
+#endif
+
+template <typename T>
+struct ScanLoop {
+    const T* in;
+    T* out;
+    int64_t n;
+    int64_t num_blocks;
+    bool exclusive;
+    T* sums;
+
+    int64_t block_begin(int64_t block) const { return n * block / num_blocks; }
+};
+
+template <typename T>
+static void reduce_blocks(void* data, int32_t begin, int32_t end) {
+    auto& loop = *static_cast<ScanLoop<T>*>(data);
+    for (int32_t block = begin; block < end; ++block) {
+        int64_t first = loop.block_begin(block), last = loop.block_begin(block + 1);
+        loop.sums[block] = reduce_block(loop.in + first, last - first);
+    }
+}
+
+template <typename T>
+static void scan_blocks(void* data, int32_t begin, int32_t end) {
+    auto& loop = *static_cast<ScanLoop<T>*>(data);
+    for (int32_t block = begin; block < end; ++block) {
+        int64_t first = loop.block_begin(block), last = loop.block_begin(block + 1);
+        scan_block(loop.in + first, loop.out + first, last - first, loop.sums[block], loop.exclusive);
+    }
+}
+
+template <typename T>
+static void parallel_scan(int32_t num_threads, const T* in, T* out, int64_t n, bool exclusive) {
+    int64_t num_blocks = scan_blocks(num_threads, n);
+    if (num_blocks <= 1) {
+        scan_block(in, out, n, T(0), exclusive);
+        return;
+    }
+
+    std::unique_ptr<T[]> sums(new T[num_blocks]);
+    ScanLoop<T> loop = { in, out, n, num_blocks, exclusive, sums.get() };
+    anydsl_parallel_for(num_threads, 0, int32_t(num_blocks), &loop, reinterpret_cast<void*>(reduce_blocks<T>));
+
+    // Turn the block sums into the offsets of the blocks
+    T offset = 0;
+    for (int64_t block = 0; block < num_blocks; ++block) {
+        T sum = sums[block];
+        sums[block] = offset;
+        offset += sum;
+    }
+    anydsl_parallel_for(num_threads, 0, int32_t(num_blocks), &loop, reinterpret_cast<void*>(scan_blocks<T>));
+}
+
+void anydsl_scan_i32(int32_t num_threads, const int32_t* in, int32_t* out, int64_t n, bool exclusive) { parallel_scan(num_threads, in, out, n, exclusive); }
+void anydsl_scan_i64(int32_t num_threads, const int64_t* in, int64_t* out, int64_t n, bool exclusive) { parallel_scan(num_threads, in, out, n, exclusive); }
+void anydsl_scan_f32(int32_t num_threads, const float* in, float* out, int64_t n, bool exclusive) { parallel_scan(num_threads, in, out, n, exclusive); }
+
+// Stream compaction: same two passes, counting the set flags of every block first
+struct CompactLoop {
+    const int32_t* flags;
+    int32_t* indices;
+    int64_t n;
+    int64_t num_blocks;
+    int32_t* counts;
+
+    int64_t block_begin(int64_t block) const { return n * block / num_blocks; }
+};
+
+static int32_t count_flags(const int32_t* flags, int64_t first, int64_t last) {
+    int32_t count = 0;
+    for (int64_t i = first; i < last; ++i)
+        count += flags[i] != 0;
+    return count;
+}
+
+static int32_t compact_range(const int32_t* flags, int32_t* indices, int64_t first, int64_t last, int32_t offset) {
+    for (int64_t i = first; i < last; ++i) {
+        if (flags[i] != 0)
+            indices[offset++] = int32_t(i);
+    }
+    return offset;
+}
+
+static void count_blocks(void* data, int32_t begin, int32_t end) {
+    auto& loop = *static_cast<CompactLoop*>(data);
+    for (int32_t block = begin; block < end; ++block)
+        loop.counts[block] = count_flags(loop.flags, loop.block_begin(block), loop.block_begin(block + 1));
+}
+
+static void compact_blocks(void* data, int32_t begin, int32_t end) {
+    auto& loop = *static_cast<CompactLoop*>(data);
+    for (int32_t block = begin; block < end; ++block)
+        compact_range(loop.flags, loop.indices, loop.block_begin(block), loop.block_begin(block + 1), loop.counts[block]);
+}
+
+int32_t anydsl_compact(int32_t num_threads, const int32_t* flags, int32_t* indices, int32_t n) {
+    int64_t num_blocks = scan_blocks(num_threads, n);
+    if (num_blocks <= 1)
+        return compact_range(flags, indices, 0, n, 0);
+
+    std::unique_ptr<int32_t[]> counts(new int32_t[num_blocks]);
+    CompactLoop loop = { flags, indices, n, num_blocks, counts.get() };
+    anydsl_parallel_for(num_threads, 0, int32_t(num_blocks), &loop, reinterpret_cast<void*>(count_blocks));
+
+    // Turn the counts into the offsets of the blocks
+    int32_t offset = 0;
+    for (int64_t block = 0; block < num_blocks; ++block) {
+        int32_t count = counts[block];
+        counts[block] = offset;
+        offset += count;
+    }
+    anydsl_parallel_for(num_threads, 0, int32_t(num_blocks), &loop, reinterpret_cast<void*>(compact_blocks));
+    return offset;
+}
@@ -0,0 +1,459 @@
+#include <cstring>
+#include <memory>
+#include <new>
+#include <thread>
+
+#include "anydsl_runtime.h"
+#include "futex.h"
+#include "handle_table.h"
+#include "thread_pool.h"
+#include "runtime.h"
+#include "log.h"
+
+// Synchronization primitives for spawned tasks. Waiting threads spin for a short
+// while, then block on a futex. Since spawned tasks run in the thread pool, blocked
+// workers are reported to the pool, which starts more workers in the meantime.
+
+// Number of polls of the futex word before blocking
+static constexpr int spin_count = 1024;
+
+// Spinning only helps when the thread that is waited for can run at the same time
+static int num_spins() {
+    static const int spins = std::thread::hardware_concurrency() > 1 ? spin_count : 0;
+    return spins;
+}
+
+// Waits until `done()` holds. Every change that can make `done()` true must modify `word` before waking it up.
+template <typename Done>
+static void wait_until(std::atomic<int32_t>& word, Done done) {
+    for (int i = 0, n = num_spins(); i < n; ++i) {
+        if (done())
+            return;
+        cpu_relax();
+    }
+    auto& pool = ThreadPool::instance();
+    pool.block_begin();
+    while (true) {
+        int32_t value = word.load();
+        if (done())
+            break;
+        futex_wait(word, value);
+    }
+    pool.block_end();
+}
+
+struct alignas(64) Barrier {
+    int32_t count;
+    std::atomic<int32_t> arrived;
+    std::atomic<int32_t> generation;
+};
+
+struct alignas(64) Latch {
+    std::atomic<int32_t> count;
+};
+
+struct alignas(64) Semaphore {
+    std::atomic<int32_t> count;
+    std::atomic<int32_t> waiters;
+};
+
+static HandleTable<Barrier> barriers;
+static HandleTable<Latch> latches;
+static HandleTable<Semaphore> semaphores;
+
+template <typename T>
+static T* create_object(HandleTable<T>& table, int32_t& id, const char* kind) {
+    id = table.acquire();
+    if (id < 0)
+        error("Too many % objects (maximum is %)", kind, HandleTable<T>::max_handles);
+    return table.get(id);
+}
+
+template <typename T>
+static T* get_object(HandleTable<T>& table, int32_t id, const char* kind) {
+    T* object = table.get(id);
+    if (!object)
+        error("Invalid % handle %", kind, id);
+    return object;
+}
+
+int32_t anydsl_barrier_create(int32_t count) {
+    if (count <= 0)
+        error("Invalid barrier count %", count);
+    int32_t id;
+    Barrier* barrier = create_object(barriers, id, "barrier");
+    barrier->count = count;
+    barrier->arrived = 0;
+    barrier->generation = 0;
+    return id;
+}
+
+bool anydsl_barrier_wait(int32_t id) {
+    Barrier* barrier = get_object(barriers, id, "barrier");
+    int32_t generation = barrier->generation.load();
+    if (barrier->arrived.fetch_add(1) + 1 == barrier->count) {
+        // The last thread to arrive resets the barrier for the next phase and releases the others
+        barrier->arrived = 0;
+        barrier->generation.fetch_add(1);
+        futex_wake(barrier->generation);
+        return true;
+    }
+    wait_until(barrier->generation, [&] { return barrier->generation.load() != generation; });
+    return false;
+}
+
+void anydsl_barrier_destroy(int32_t id) {
+    get_object(barriers, id, "barrier");
+    barriers.release(id);
+}
+
+int32_t anydsl_latch_create(int32_t count) {
+    int32_t id;
+    Latch* latch = create_object(latches, id, "latch");
+    latch->count = count;
+    return id;
+}
+
+void anydsl_latch_count_down(int32_t id, int32_t n) {
+    Latch* latch = get_object(latches, id, "latch");
+    int32_t count = latch->count.fetch_sub(n) - n;
+    if (count <= 0 && count + n > 0)
+        futex_wake(latch->count);
+}
+
+bool anydsl_latch_try_wait(int32_t id) {
+    return get_object(latches, id, "latch")->count.load() <= 0;
+}
+
+void anydsl_latch_wait(int32_t id) {
+    Latch* latch = get_object(latches, id, "latch");
+    wait_until(latch->count, [&] { return latch->count.load() <= 0; });
+}
+
+void anydsl_latch_destroy(int32_t id) {
+    get_object(latches, id, "latch");
+    latches.release(id);
+}
+
+int32_t anydsl_semaphore_create(int32_t count) {
+    int32_t id;
+    Semaphore* semaphore = create_object(semaphores, id, "semaphore");
+    semaphore->count = count;
+    semaphore->waiters = 0;
+    return id;
+}
+
+static bool try_acquire(Semaphore* semaphore) {
+    int32_t count = semaphore->count.load();
+    while (count > 0) {
+        if (semaphore->count.compare_exchange_weak(count, count - 1))
+            return true;
+    }
+    return false;
+}
+
+bool anydsl_semaphore_try_acquire(int32_t id) {
+    return try_acquire(get_object(semaphores, id, "semaphore"));
+}
+
+void anydsl_semaphore_acquire(int32_t id) {
+    Semaphore* semaphore = get_object(semaphores, id, "semaphore");
+    if (try_acquire(semaphore))
+        return;
+    semaphore->waiters.fetch_add(1);
+    wait_until(semaphore->count, [&] { return try_acquire(semaphore); });
+    semaphore->waiters.fetch_sub(1);
+}
+
+void anydsl_semaphore_release(int32_t id, int32_t n) {
+    Semaphore* semaphore = get_object(semaphores, id, "semaphore");
+    semaphore->count.fetch_add(n);
+    if (semaphore->waiters.load() > 0)
+        futex_wake(semaphore->count, n);
+}
+
+void anydsl_semaphore_destroy(int32_t id) {
+    get_object(semaphores, id, "semaphore");
+    semaphores.release(id);
+}
+
+// Channels: bounded multi-producer multi-consumer rings (which also serve single producers
+// and consumers). Every cell holds a sequence number that tells whether it is ready to be
+// written or read for a given position, so producers and consumers only contend on the
+// head and tail counters, each on its own cache line.
+struct Channel {
+    alignas(64) std::atomic<uint64_t> head;  ///< Position of the next element to pop
+    alignas(64) std::atomic<uint64_t> tail;  ///< Position of the next element to push
+    alignas(64) std::atomic<int32_t> pushed; ///< Incremented after pushes, wakes up blocked consumers
+    std::atomic<int32_t> pop_waiters;
+    alignas(64) std::atomic<int32_t> popped; ///< Incremented after pops, wakes up blocked producers
+    std::atomic<int32_t> push_waiters;
+    alignas(64) char* cells;
+    size_t cell_size;
+    size_t elem_size;
+    uint64_t mask;
+    std::atomic<bool> closed;
+
+    std::atomic<uint64_t>& sequence(uint64_t pos) { return *reinterpret_cast<std::atomic<uint64_t>*>(cells + (pos & mask) * cell_size); }
+    char* data(uint64_t pos) { return cells + (pos & mask) * cell_size + sizeof(uint64_t); }
+
+    bool try_push(const void* elem) {
+        uint64_t pos = tail.load(std::memory_order_relaxed);
+        while (true) {
+            int64_t diff = int64_t(sequence(pos).load(std::memory_order_acquire) - pos);
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+        std::memcpy(data(pos), elem, elem_size);
+        sequence(pos).store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(void* elem) {
+        uint64_t pos = head.load(std::memory_order_relaxed);
+        while (true) {
+            int64_t diff = int64_t(sequence(pos).load(std::memory_order_acquire) - (pos + 1));
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+        std::memcpy(elem, data(pos), elem_size);
+        sequence(pos).store(pos + mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    void notify(std::atomic<int32_t>& word, std::atomic<int32_t>& waiters, int32_t count) {
+        word.fetch_add(1);
+        if (waiters.load() > 0)
+            futex_wake(word, count);
+    }
+};
+
+static HandleTable<Channel> channels;
+
+int32_t anydsl_channel_create(int32_t elem_size, int32_t capacity) {
+    if (elem_size <= 0 || capacity <= 0)
+        error("Invalid channel element size % or capacity %", elem_size, capacity);
+    int32_t id;
+    Channel* channel = create_object(channels, id, "channel");
+    // With a single cell, a full cell would look ready for the next push: rings have at least two cells
+    uint64_t size = 2;
+    while (size < uint64_t(capacity))
+        size *= 2;
+    channel->elem_size = elem_size;
+    channel->cell_size = (sizeof(uint64_t) + elem_size + 7) & ~size_t(7);
+    channel->mask = size - 1;
+    channel->cells = static_cast<char*>(Runtime::aligned_malloc(channel->cell_size * size, 64));
+    for (uint64_t pos = 0; pos < size; ++pos)
+        new (&channel->sequence(pos)) std::atomic<uint64_t>(pos);
+    channel->head = 0;
+    channel->tail = 0;
+    channel->pushed = 0;
+    channel->popped = 0;
+    channel->pop_waiters = 0;
+    channel->push_waiters = 0;
+    channel->closed = false;
+    return id;
+}
+
+void anydsl_channel_destroy(int32_t id) {
+    Channel* channel = get_object(channels, id, "channel");
+    Runtime::aligned_free(channel->cells);
+    channels.release(id);
+}
+
+void anydsl_channel_close(int32_t id) {
+    Channel* channel = get_object(channels, id, "channel");
+    channel->closed = true;
+    channel->pushed.fetch_add(1);
+    channel->popped.fetch_add(1);
+    futex_wake(channel->pushed);
+    futex_wake(channel->popped);
+}
+
+int32_t anydsl_channel_try_push_batch(int32_t id, const void* elems, int32_t count) {
+    Channel* channel = get_object(channels, id, "channel");
+    auto src = static_cast<const char*>(elems);
+    int32_t n = 0;
+    while (n < count && !channel->closed.load(std::memory_order_relaxed) && channel->try_push(src + n * channel->elem_size))
+        n++;
+    if (n > 0)
+        channel->notify(channel->pushed, channel->pop_waiters, n);
+    return n;
+}
+
+int32_t anydsl_channel_try_pop_batch(int32_t id, void* elems, int32_t count) {
+    Channel* channel = get_object(channels, id, "channel");
+    auto dst = static_cast<char*>(elems);
+    int32_t n = 0;
+    while (n < count && channel->try_pop(dst + n * channel->elem_size))
+        n++;
+    if (n > 0)
+        channel->notify(channel->popped, channel->push_waiters, n);
+    return n;
+}
+
+int32_t anydsl_channel_push_batch(int32_t id, const void* elems, int32_t count) {
+    Channel* channel = get_object(channels, id, "channel");
+    auto src = static_cast<const char*>(elems);
+    int32_t n = anydsl_channel_try_push_batch(id, src, count);
+    if (n == count)
+        return n;
+    channel->push_waiters.fetch_add(1);
+    wait_until(channel->popped, [&] {
+        n += anydsl_channel_try_push_batch(id, src + n * channel->elem_size, count - n);
+        return n == count || channel->closed.load();
+    });
+    channel->push_waiters.fetch_sub(1);
+    return n;
+}
+
+int32_t anydsl_channel_pop_batch(int32_t id, void* elems, int32_t count) {
+    Channel* channel = get_object(channels, id, "channel");
+    int32_t n = anydsl_channel_try_pop_batch(id, elems, count);
+    if (n > 0 || count <= 0)
+        return n;
+    channel->pop_waiters.fetch_add(1);
+    wait_until(channel->pushed, [&] {
+        // A closed channel is only done once it has been drained
+        bool closed = channel->closed.load();
+        n = anydsl_channel_try_pop_batch(id, elems, count);
+        return n > 0 || closed;
+    });
+    channel->pop_waiters.fetch_sub(1);
+    return n;
+}
+
+bool anydsl_channel_try_push(int32_t id, const void* elem) { return anydsl_channel_try_push_batch(id, elem, 1) == 1; }
+bool anydsl_channel_try_pop(int32_t id, void* elem) { return anydsl_channel_try_pop_batch(id, elem, 1) == 1; }
+bool anydsl_channel_push(int32_t id, const void* elem) { return anydsl_channel_push_batch(id, elem, 1) == 1; }
+bool anydsl_channel_pop(int32_t id, void* elem) { return anydsl_channel_pop_batch(id, elem, 1) == 1; }
+
+// Software pipelines: every stage runs in its own task and processes the iterations in order.
+// Stage s starts an iteration once stage s - 1 has finished it, and may run at most `depth`
+// iterations ahead of stage s + 1, as if the two were connected by a bounded ring of iterations.
+// The stages are either run by anydsl_pipeline_for, or by tasks of the caller which bracket every
+// iteration with anydsl_pipeline_begin and anydsl_pipeline_end (see cpu_pipeline in Artic).
+static constexpr int32_t default_pipeline_depth = 64;
+
+struct alignas(64) PipelineStage {
+    std::atomic<int32_t> done;    ///< Number of iterations finished by this stage
+    std::atomic<int32_t> waiters; ///< Number of neighbouring stages blocked on `done`
+};
+
+struct Pipeline {
+    int32_t num_stages;
+    int32_t depth;
+    std::unique_ptr<PipelineStage[]> stages;
+};
+
+struct PipelineLoop {
+    Pipeline pipeline;
+    void (*fn)(void*, int32_t, int32_t);
+    void* args;
+    int32_t lower;
+    int32_t upper;
+};
+
+static HandleTable<Pipeline> pipelines;
+
+static void init_pipeline(Pipeline& pipeline, int32_t num_stages, int32_t depth) {
+    if (num_stages <= 0)
+        error("Invalid number of pipeline stages %", num_stages);
+    pipeline.num_stages = num_stages;
+    pipeline.depth = depth > 0 ? depth : default_pipeline_depth;
+    pipeline.stages.reset(new PipelineStage[num_stages]);
+    for (int32_t i = 0; i < num_stages; ++i) {
+        pipeline.stages[i].done = 0;
+        pipeline.stages[i].waiters = 0;
+    }
+}
+
+static void wait_for_stage(PipelineStage& stage, int32_t count) {
+    if (stage.done.load(std::memory_order_acquire) >= count)
+        return;
+    stage.waiters.fetch_add(1);
+    wait_until(stage.done, [&] { return stage.done.load() >= count; });
+    stage.waiters.fetch_sub(1);
+}
+
+// Waits until stage `index` may run the iteration `n` (counted from the start of the loop)
+static void begin_stage(Pipeline& pipeline, int32_t index, int32_t n) {
+    if (index > 0)
+        wait_for_stage(pipeline.stages[index - 1], n + 1);
+    if (index + 1 < pipeline.num_stages)
+        wait_for_stage(pipeline.stages[index + 1], n + 1 - pipeline.depth);
+}
+
+static void end_stage(Pipeline& pipeline, int32_t index) {
+    PipelineStage& stage = pipeline.stages[index];
+    stage.done.fetch_add(1);
+    if (stage.waiters.load() > 0)
+        futex_wake(stage.done);
+}
+
+static void run_pipeline_stage(void* data, int64_t begin, int64_t) {
+    auto& loop = *static_cast<PipelineLoop*>(data);
+    int32_t index = int32_t(begin);
+    for (int32_t i = 0, n = loop.upper - loop.lower; i < n; ++i) {
+        begin_stage(loop.pipeline, index, i);
+        loop.fn(loop.args, index, loop.lower + i);
+        end_stage(loop.pipeline, index);
+    }
+}
+
+void anydsl_pipeline_for(int32_t num_stages, int32_t lower, int32_t upper, int32_t depth, void* args, void* fun) {
+    PipelineLoop loop;
+    init_pipeline(loop.pipeline, num_stages, depth);
+    if (lower >= upper)
+        return;
+    loop.fn = reinterpret_cast<void (*)(void*, int32_t, int32_t)>(fun);
+    loop.args = args;
+    loop.lower = lower;
+    loop.upper = upper;
+
+    // The calling thread runs the first stage, the others are detached tasks with a worker each:
+    // a thread waiting for a loop must never pick up a stage on top of the stage it is running.
+    auto& pool = ThreadPool::instance();
+    TaskGroup group;
+    for (int32_t i = 1; i < num_stages; ++i)
+        pool.submit_detached(group, run_pipeline_stage, &loop, i, i + 1);
+    run_pipeline_stage(&loop, 0, 1);
+    pool.wait_blocked(group);
+}
+
+int32_t anydsl_pipeline_create(int32_t num_stages, int32_t depth) {
+    int32_t id;
+    init_pipeline(*create_object(pipelines, id, "pipeline"), num_stages, depth);
+    return id;
+}
+
+void anydsl_pipeline_begin(int32_t id, int32_t stage, int32_t n) {
+    Pipeline* pipeline = get_object(pipelines, id, "pipeline");
+    if (stage < 0 || stage >= pipeline->num_stages)
+        error("Invalid pipeline stage %", stage);
+    begin_stage(*pipeline, stage, n);
+}
+
+void anydsl_pipeline_end(int32_t id, int32_t stage) {
+    Pipeline* pipeline = get_object(pipelines, id, "pipeline");
+    if (stage < 0 || stage >= pipeline->num_stages)
+        error("Invalid pipeline stage %", stage);
+    end_stage(*pipeline, stage);
+}
+
+void anydsl_pipeline_destroy(int32_t id) {
+    get_object(pipelines, id, "pipeline")->stages.reset();
+    pipelines.release(id);
+}
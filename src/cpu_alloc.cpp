@@ -0,0 +1,485 @@
+#include "cpu_alloc.h"
+#include "numa.h"
+#include "runtime.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+// Every block starts with a header, placed just before the pointer returned to the user
+struct BlockHeader {
+    uint64_t size;            ///< Size of the block, without the header
+    uint32_t bin;             ///< Bin of the block, `no_bin` if it is not cached, or `mapped_bin` if it has its own mapping
+    uint16_t offset;          ///< Distance from the start of the underlying allocation to the block
+    CpuAllocator::Pages pages;
+    uint8_t mapped;           ///< Whether the underlying allocation is a mapping of its own
+};
+
+static constexpr uint32_t no_bin = UINT32_MAX;
+static constexpr uint32_t mapped_bin = UINT32_MAX - 1;
+static constexpr size_t page_size = 4096;
+// Cache limit (in MiB per logical CPU) when ANYDSL_ALLOC_CACHE is not set
+static constexpr size_t default_limit_per_cpu = 4;
+
+static BlockHeader* header(void* ptr) {
+    return reinterpret_cast<BlockHeader*>(static_cast<char*>(ptr) - sizeof(BlockHeader));
+}
+
+static size_t round_to_pages(size_t size) {
+    return (size + page_size - 1) & ~(page_size - 1);
+}
+
+static int highest_bit(size_t n) {
+#if defined(__GNUC__)
+    return 63 - __builtin_clzll(n);
+#else
+    int bit = 0;
+    while (n >>= 1)
+        bit++;
+    return bit;
+#endif
+}
+
+struct CpuAllocator::ThreadCache {
+    Magazine magazines[num_bins];
+    std::atomic<int64_t> hits;
+    std::atomic<int64_t> misses;
+    uint32_t epoch;
+
+    // Counters are only written by the owning thread, and read by `stats()`
+    static void count(std::atomic<int64_t>& counter) { counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); }
+};
+
+// Set when the cache of the thread is destroyed: memory released later on by the thread goes to the depots
+static thread_local bool thread_exited = false;
+
+struct ThreadCacheOwner {
+    CpuAllocator::ThreadCache* cache = nullptr;
+    ~ThreadCacheOwner();
+};
+
+static thread_local ThreadCacheOwner thread_cache_owner;
+
+CpuAllocator& CpuAllocator::instance() {
+    // Never destroyed: threads may still release memory while the process exits
+    static CpuAllocator* allocator = new CpuAllocator();
+    return *allocator;
+}
+
+static size_t detect_huge_page_size() {
+    std::ifstream file("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size");
+    size_t size = 0;
+    if (file >> size && size > page_size && (size & (size - 1)) == 0)
+        return size;
+    return 2 << 20;
+}
+
+static bool detect_transparent_huge_pages() {
+    // The active mode is in brackets, e.g. "always [madvise] never"
+    std::ifstream file("/sys/kernel/mm/transparent_hugepage/enabled");
+    std::string modes;
+    return std::getline(file, modes) && modes.find("[never]") == std::string::npos;
+}
+
+CpuAllocator::CpuAllocator()
+    : retained_(0), limit_((default_limit_per_cpu * numa_cpus().size()) << 20), epoch_(0)
+    , huge_page_size_(detect_huge_page_size())
+    , thp_enabled_(detect_transparent_huge_pages())
+    , huge_by_env_(false)
+    , num_nodes_(numa_nodes().size())
+    , node_depots_(new Depot[num_nodes_ * num_bins])
+    , exited_hits_(0), exited_misses_(0)
+{
+    const char* env_var = std::getenv("ANYDSL_ALLOC_CACHE");
+    if (env_var)
+        limit_ = size_t(std::max(0ll, std::atoll(env_var))) << 20;
+    env_var = std::getenv("ANYDSL_HUGE_PAGES");
+    huge_by_env_ = env_var && std::strcmp(env_var, "0") != 0;
+}
+
+size_t CpuAllocator::class_index(size_t size) {
+    if (size <= min_size)
+        return 0;
+    // Four classes per power of two, given by the two bits that follow the highest one
+    size_t n = size - 1;
+    int bit = highest_bit(n);
+    return size_t(bit - 6) * 4 + ((n >> (bit - 2)) & 3) + 1;
+}
+
+size_t CpuAllocator::class_size(size_t index) {
+    return (4 + (index & 3)) << ((index >> 2) + 4);
+}
+
+size_t CpuAllocator::magazine_capacity(size_t bin) {
+    return std::min(magazine_size, std::max(size_t(1), magazine_bytes / bin_size(bin)));
+}
+
+size_t CpuAllocator::header_offset(size_t alignment) {
+    return alignment > min_size ? page_size : min_size;
+}
+
+CpuAllocator::ThreadCache* CpuAllocator::thread_cache() {
+    if (thread_exited)
+        return nullptr;
+    ThreadCache* cache = thread_cache_owner.cache;
+    if (!cache) {
+        cache = new ThreadCache();
+        for (auto& magazine : cache->magazines)
+            magazine.count = 0;
+        cache->hits = 0;
+        cache->misses = 0;
+        cache->epoch = epoch_.load();
+        std::lock_guard<std::mutex> guard(threads_lock_);
+        threads_.push_back(cache);
+        thread_cache_owner.cache = cache;
+    }
+    if (cache->epoch != epoch_.load(std::memory_order_relaxed)) {
+        // The caches have been trimmed since the last call
+        cache->epoch = epoch_.load();
+        flush(*cache, false);
+    }
+    return cache;
+}
+
+ThreadCacheOwner::~ThreadCacheOwner() {
+    thread_exited = true;
+    if (!cache)
+        return;
+    auto& allocator = CpuAllocator::instance();
+    allocator.flush(*cache, true);
+    {
+        std::lock_guard<std::mutex> guard(allocator.threads_lock_);
+        allocator.threads_.erase(std::find(allocator.threads_.begin(), allocator.threads_.end(), cache));
+        allocator.exited_hits_ += cache->hits.load();
+        allocator.exited_misses_ += cache->misses.load();
+    }
+    delete cache;
+}
+
+void* CpuAllocator::alloc_block(size_t bin) {
+    size_t offset = bin % num_bins < num_classes ? min_size : page_size;
+    size_t size = bin_size(bin);
+    if (bin >= num_bins) {
+        int32_t node = int32_t(bin / num_bins) - 1;
+        void* ptr = alloc_mapped(size, offset, node);
+        if (!ptr && retained_.load() > 0) {
+            trim();
+            ptr = alloc_mapped(size, offset, node);
+        }
+        if (ptr)
+            header(ptr)->bin = uint32_t(bin);
+        return ptr;
+    }
+
+    void* raw = Runtime::aligned_malloc(offset + size, offset);
+    if (!raw && retained_.load() > 0) {
+        // Give the cached memory back before failing
+        trim();
+        raw = Runtime::aligned_malloc(offset + size, offset);
+    }
+    if (!raw)
+        return nullptr;
+    void* ptr = static_cast<char*>(raw) + offset;
+    *header(ptr) = BlockHeader { size, uint32_t(bin), uint16_t(offset), Pages::Default, 0 };
+    return ptr;
+}
+
+// Memory policies apply to whole pages: blocks bound to a node get a mapping of their own,
+// bound before any of its pages is touched.
+void* CpuAllocator::alloc_mapped(size_t size, size_t offset, int32_t node) {
+#if defined(__linux__)
+    size_t length = round_to_pages(offset + size);
+    void* raw = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED)
+        return nullptr;
+    bind_memory(raw, length, node);
+    void* ptr = static_cast<char*>(raw) + offset;
+    *header(ptr) = BlockHeader { size, no_bin, uint16_t(offset), Pages::Default, 1 };
+    return ptr;
+#else
+    (void)node;
+    void* raw = Runtime::aligned_malloc(offset + size, offset);
+    if (!raw)
+        return nullptr;
+    void* ptr = static_cast<char*>(raw) + offset;
+    *header(ptr) = BlockHeader { size, no_bin, uint16_t(offset), Pages::Default, 0 };
+    return ptr;
+#endif
+}
+
+// Huge pages need their own mapping, aligned to the huge page size. The header is kept on
+// a regular page placed just before it, so that no huge page is wasted on it.
+void* CpuAllocator::alloc_huge(size_t size, int32_t node) {
+#if defined(__linux__)
+    size_t huge_size = huge_page_size_;
+    size_t data_size = std::max(size_t(1), (size + huge_size - 1) / huge_size) * huge_size;
+    size_t reserved_size = page_size + data_size + huge_size;
+    void* reserved = mmap(nullptr, reserved_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (reserved == MAP_FAILED)
+        return nullptr;
+    char* begin = static_cast<char*>(reserved);
+    char* data = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(begin) + page_size + huge_size - 1) & ~uintptr_t(huge_size - 1));
+    char* end = begin + reserved_size;
+
+    Pages pages = Pages::Default;
+#if defined(MAP_HUGETLB)
+    if (mmap(data, data_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB, -1, 0) != MAP_FAILED)
+        pages = Pages::HugeTLB;
+#endif
+    if (pages == Pages::Default) {
+        // No huge pages are reserved, fall back to transparent huge pages, or regular pages
+        if (mmap(data, data_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED) {
+            munmap(begin, reserved_size);
+            return nullptr;
+        }
+#if defined(MADV_HUGEPAGE)
+        if (thp_enabled_ && madvise(data, data_size, MADV_HUGEPAGE) == 0)
+            pages = Pages::Transparent;
+#endif
+    }
+    if (node >= 0)
+        bind_memory(data, data_size, size_t(node));
+    if (mprotect(data - page_size, page_size, PROT_READ | PROT_WRITE) != 0) {
+        munmap(begin, reserved_size);
+        return nullptr;
+    }
+
+    // Give back the parts of the reserved range that are not used
+    if (data - page_size > begin)
+        munmap(begin, data - page_size - begin);
+    if (data + data_size < end)
+        munmap(data + data_size, end - (data + data_size));
+    *header(data) = BlockHeader { data_size, mapped_bin, uint16_t(page_size), pages, 1 };
+    return data;
+#else
+    (void)size; (void)node;
+    return nullptr;
+#endif
+}
+
+void CpuAllocator::free_block(void* ptr) {
+    BlockHeader* block = header(ptr);
+    char* raw = static_cast<char*>(ptr) - block->offset;
+#if defined(__linux__)
+    if (block->mapped) {
+        munmap(raw, round_to_pages(block->offset + block->size));
+        return;
+    }
+#endif
+    Runtime::aligned_free(raw);
+}
+
+CpuAllocator::Pages CpuAllocator::pages(void* ptr) {
+    return header(ptr)->pages;
+}
+
+void CpuAllocator::count_miss(ThreadCache* cache) {
+    if (cache)
+        ThreadCache::count(cache->misses);
+    else
+        exited_misses_++;
+}
+
+void* CpuAllocator::alloc(size_t size, size_t alignment, bool huge_pages, int32_t node) {
+    if (alignment > page_size)
+        error("Unsupported alignment % for host memory", alignment);
+    if (node >= 0 && size_t(node) >= num_nodes_)
+        error("Invalid NUMA node %", node);
+
+    size_t index = class_index(size);
+    ThreadCache* cache = thread_cache();
+    if (huge_pages || (huge_by_env_ && alignment >= page_size && size >= huge_page_size_)) {
+        // Huge page mappings are never cached, they fall back to the other blocks if they cannot be mapped
+        if (void* ptr = alloc_huge(size, node)) {
+            count_miss(cache);
+            return ptr;
+        }
+    }
+    if (node >= 0)
+        return alloc_node(size, alignment, node, cache);
+    if (index >= num_classes) {
+        // Too large to be cached
+        count_miss(cache);
+        size_t offset = header_offset(alignment);
+        void* raw = Runtime::aligned_malloc(offset + size, offset);
+        if (!raw)
+            return nullptr;
+        void* ptr = static_cast<char*>(raw) + offset;
+        *header(ptr) = BlockHeader { size, no_bin, uint16_t(offset), Pages::Default, 0 };
+        return ptr;
+    }
+
+    size_t bin = index + (alignment > min_size ? num_classes : 0);
+    void* ptr = nullptr;
+    if (cache) {
+        Magazine& magazine = cache->magazines[bin];
+        if (magazine.count == 0) {
+            // Refill half of the magazine from the depot
+            Depot& depot = depot_of(bin);
+            std::lock_guard<std::mutex> guard(depot.lock);
+            size_t count = std::min(depot.blocks.size(), (magazine_capacity(bin) + 1) / 2);
+            std::copy(depot.blocks.end() - count, depot.blocks.end(), magazine.blocks);
+            depot.blocks.resize(depot.blocks.size() - count);
+            magazine.count = uint32_t(count);
+        }
+        if (magazine.count > 0)
+            ptr = magazine.blocks[--magazine.count];
+        ThreadCache::count(ptr ? cache->hits : cache->misses);
+    } else {
+        ptr = pop_depot(bin);
+        (ptr ? exited_hits_ : exited_misses_)++;
+    }
+
+    if (!ptr)
+        return alloc_block(bin);
+    retained_.fetch_sub(bin_size(bin));
+    return ptr;
+}
+
+void* CpuAllocator::pop_depot(size_t bin) {
+    Depot& depot = depot_of(bin);
+    std::lock_guard<std::mutex> guard(depot.lock);
+    if (depot.blocks.empty())
+        return nullptr;
+    void* ptr = depot.blocks.back();
+    depot.blocks.pop_back();
+    return ptr;
+}
+
+// Node blocks skip the magazines: they are few and large, and a thread rarely reuses them
+void* CpuAllocator::alloc_node(size_t size, size_t alignment, int32_t node, ThreadCache* cache) {
+    size_t index = class_index(size);
+    if (index >= num_classes) {
+        count_miss(cache);
+        return alloc_mapped(size, header_offset(alignment), node);
+    }
+
+    size_t bin = size_t(node + 1) * num_bins + index + (alignment > min_size ? num_classes : 0);
+    void* ptr = pop_depot(bin);
+    if (cache)
+        ThreadCache::count(ptr ? cache->hits : cache->misses);
+    else
+        (ptr ? exited_hits_ : exited_misses_)++;
+
+    if (!ptr)
+        return alloc_block(bin);
+    retained_.fetch_sub(bin_size(bin));
+    return ptr;
+}
+
+void CpuAllocator::release(void* ptr) {
+    if (!ptr)
+        return;
+    size_t bin = header(ptr)->bin;
+    if (bin == no_bin || bin == mapped_bin) {
+        free_block(ptr);
+        return;
+    }
+
+    size_t size = bin_size(bin);
+    if (retained_.fetch_add(size) + size > limit_.load(std::memory_order_relaxed)) {
+        retained_.fetch_sub(size);
+        free_block(ptr);
+        return;
+    }
+
+    ThreadCache* cache = bin < num_bins ? thread_cache() : nullptr;
+    if (cache) {
+        Magazine& magazine = cache->magazines[bin];
+        size_t capacity = magazine_capacity(bin);
+        if (magazine.count == capacity) {
+            // Move the oldest half of the magazine to the depot, keep the blocks that were used last
+            size_t count = capacity - capacity / 2;
+            Depot& depot = depot_of(bin);
+            {
+                std::lock_guard<std::mutex> guard(depot.lock);
+                depot.blocks.insert(depot.blocks.end(), magazine.blocks, magazine.blocks + count);
+            }
+            std::copy(magazine.blocks + count, magazine.blocks + capacity, magazine.blocks);
+            magazine.count -= uint32_t(count);
+        }
+        magazine.blocks[magazine.count++] = ptr;
+    } else {
+        Depot& depot = depot_of(bin);
+        std::lock_guard<std::mutex> guard(depot.lock);
+        depot.blocks.push_back(ptr);
+    }
+}
+
+void CpuAllocator::flush(ThreadCache& cache, bool to_depot) {
+    for (size_t bin = 0; bin < num_bins; ++bin) {
+        Magazine& magazine = cache.magazines[bin];
+        if (magazine.count == 0)
+            continue;
+        if (to_depot) {
+            Depot& depot = depots_[bin];
+            std::lock_guard<std::mutex> guard(depot.lock);
+            depot.blocks.insert(depot.blocks.end(), magazine.blocks, magazine.blocks + magazine.count);
+        } else {
+            for (uint32_t i = 0; i < magazine.count; ++i)
+                free_block(magazine.blocks[i]);
+            retained_.fetch_sub(magazine.count * bin_size(bin));
+        }
+        magazine.count = 0;
+    }
+}
+
+void CpuAllocator::shrink(size_t limit) {
+    // Free the largest blocks first, they are the least likely to be reused
+    for (size_t i = 0; i < num_bins && retained_.load() > limit; ++i) {
+        size_t first_bin = (num_classes - 1 - i % num_classes) + (i < num_classes ? 0 : num_classes);
+        for (size_t bin = first_bin; bin < (num_nodes_ + 1) * num_bins; bin += num_bins) {
+            Depot& depot = depot_of(bin);
+            std::vector<void*> blocks;
+            {
+                std::lock_guard<std::mutex> guard(depot.lock);
+                blocks.swap(depot.blocks);
+            }
+            for (void* block : blocks)
+                free_block(block);
+            retained_.fetch_sub(blocks.size() * bin_size(bin));
+        }
+    }
+}
+
+void CpuAllocator::trim() {
+    epoch_.fetch_add(1);
+    if (ThreadCache* cache = thread_cache())
+        flush(*cache, false);
+    shrink(0);
+#if defined(__GLIBC__)
+    malloc_trim(0);
+#endif
+}
+
+void CpuAllocator::set_limit(size_t limit) {
+    limit_ = limit;
+    if (retained_.load() > limit) {
+        shrink(limit);
+        // The magazines of the threads are emptied the next time these threads use the allocator
+        if (retained_.load() > limit)
+            epoch_.fetch_add(1);
+    }
+}
+
+CpuAllocator::Stats CpuAllocator::stats() {
+    Stats stats = { 0, 0, int64_t(retained_.load()), int64_t(limit_.load()) };
+    std::lock_guard<std::mutex> guard(threads_lock_);
+    stats.hits = exited_hits_.load();
+    stats.misses = exited_misses_.load();
+    for (auto cache : threads_) {
+        stats.hits += cache->hits.load(std::memory_order_relaxed);
+        stats.misses += cache->misses.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
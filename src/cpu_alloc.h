@@ -0,0 +1,109 @@
+#ifndef CPU_ALLOC_H
+#define CPU_ALLOC_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/// Caching allocator for host memory. Freed blocks are kept in bins of geometrically growing
+/// sizes (four classes per power of two) and reused by later allocations of the same class.
+/// Every thread keeps a small magazine of blocks per bin, backed by a shared depot per bin.
+/// Blocks bound to a NUMA node are mapped separately and only cached in the depots of that node.
+/// The memory retained by the caches is limited, blocks released above the limit are freed.
+class CpuAllocator {
+public:
+    /// Kind of pages backing a block.
+    enum class Pages : uint8_t {
+        Default = 0,     ///< Regular pages
+        Transparent = 1, ///< Transparent huge pages requested with `madvise()`, the kernel backs the block with huge pages when possible
+        HugeTLB = 2      ///< Huge pages reserved by the system (`MAP_HUGETLB`)
+    };
+
+    struct Stats {
+        int64_t hits;     ///< Allocations served from the caches
+        int64_t misses;   ///< Allocations that needed new memory
+        int64_t retained; ///< Bytes currently held by the caches
+        int64_t limit;    ///< Maximum number of bytes held by the caches
+    };
+
+    /// Returns the allocator of the process. The initial limit is read from `ANYDSL_ALLOC_CACHE` (in MiB),
+    /// and defaults to a few MiB per logical CPU.
+    static CpuAllocator& instance();
+
+    /// Allocates `size` bytes aligned to at least 64 bytes, or to `alignment` if larger.
+    /// With `huge_pages`, or for page-aligned blocks of at least one huge page when `ANYDSL_HUGE_PAGES`
+    /// is set, the block is mapped separately and backed by huge pages if the system provides them.
+    /// If `node` is not negative, the pages of the block are bound to that node (index in `numa_nodes()`).
+    void* alloc(size_t size, size_t alignment, bool huge_pages = false, int32_t node = -1);
+    /// Returns a block obtained from `alloc()` to the caches, or frees it if they are full.
+    void release(void* ptr);
+    /// Returns the kind of pages that back a block obtained from `alloc()`.
+    static Pages pages(void* ptr);
+
+    /// Frees the blocks held by the caches and returns as much memory as possible to the system.
+    /// The magazines of other threads are freed the next time these threads allocate or release memory.
+    void trim();
+    /// Sets the maximum number of bytes held by the caches (0 disables caching).
+    void set_limit(size_t limit);
+    Stats stats();
+
+private:
+    static constexpr size_t min_size = 64;
+    static constexpr size_t num_classes = 89;                 ///< Classes from 64 bytes to 256 MiB
+    static constexpr size_t num_bins = 2 * num_classes;       ///< Cache line and page aligned blocks are kept apart
+    static constexpr size_t magazine_size = 8;
+    static constexpr size_t magazine_bytes = 1 << 20;         ///< Bytes held by a magazine before it spills to the depot
+
+    struct Magazine {
+        uint32_t count;
+        void* blocks[magazine_size];
+    };
+
+    struct ThreadCache;
+
+    struct alignas(64) Depot {
+        std::mutex lock;
+        std::vector<void*> blocks;
+    };
+
+    CpuAllocator();
+
+    static size_t class_index(size_t size);
+    static size_t class_size(size_t index);
+    static size_t bin_size(size_t bin) { return class_size(bin % num_classes); }
+    static size_t magazine_capacity(size_t bin);
+    static size_t header_offset(size_t alignment);
+
+    ThreadCache* thread_cache();
+    void count_miss(ThreadCache* cache);
+    Depot& depot_of(size_t bin) { return bin < num_bins ? depots_[bin] : node_depots_[bin - num_bins]; }
+    void* alloc_block(size_t bin);
+    void* alloc_mapped(size_t size, size_t offset, int32_t node);
+    void* alloc_huge(size_t size, int32_t node);
+    void* alloc_node(size_t size, size_t alignment, int32_t node, ThreadCache* cache);
+    void* pop_depot(size_t bin);
+    void free_block(void* ptr);
+    void flush(ThreadCache& cache, bool keep);
+    void shrink(size_t limit);
+
+    Depot depots_[num_bins];
+    std::atomic<size_t> retained_;
+    std::atomic<size_t> limit_;
+    std::atomic<uint32_t> epoch_;
+    size_t huge_page_size_;
+    bool thp_enabled_;    ///< Whether transparent huge pages can be requested with `madvise()`
+    bool huge_by_env_;    ///< Whether `ANYDSL_HUGE_PAGES` requests huge pages for large page-aligned blocks
+    size_t num_nodes_;
+    std::unique_ptr<Depot[]> node_depots_; ///< Bins of node `n` start at `(n + 1) * num_bins`
+    std::mutex threads_lock_;
+    std::vector<ThreadCache*> threads_;
+    std::atomic<int64_t> exited_hits_;   ///< Counters of the threads whose cache has been destroyed
+    std::atomic<int64_t> exited_misses_;
+
+    friend struct ThreadCacheOwner;
+};
+
+#endif
@@ -0,0 +1,153 @@
+#include "cpu_copy.h"
+#include "numa.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define ANYDSL_COPY_X86
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+#if defined(__GNUC__)
+#define ANYDSL_TARGET(isa) __attribute__((target(isa)))
+#else
+#define ANYDSL_TARGET(isa)
+#endif
+
+// Copies below this size are done by the calling thread
+static constexpr size_t parallel_copy_size = 4 << 20;
+// Copies are split in chunks of this size, contiguous chunks go to the same thread
+static constexpr size_t copy_chunk_size = 1 << 20;
+
+typedef void (*CopyFn)(char*, const char*, size_t);
+
+static void copy_memcpy(char* dst, const char* src, size_t size) {
+    std::memcpy(dst, src, size);
+}
+
+#ifdef ANYDSL_COPY_X86
+// Streaming copies: unaligned loads, aligned non-temporal stores that bypass the caches.
+// The bytes before the first aligned destination address and after the last full block use memcpy.
+static void stream_copy_sse2(char* dst, const char* src, size_t size) {
+    size_t head = std::min(size, size_t(-reinterpret_cast<uintptr_t>(dst) & 15));
+    std::memcpy(dst, src, head);
+    dst += head; src += head; size -= head;
+    for (; size >= 64; dst += 64, src += 64, size -= 64) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 32));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 48));
+        _mm_stream_si128(reinterpret_cast<__m128i*>(dst),      a);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(dst + 16), b);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(dst + 32), c);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(dst + 48), d);
+    }
+    _mm_sfence();
+    std::memcpy(dst, src, size);
+}
+
+ANYDSL_TARGET("avx2")
+static void stream_copy_avx2(char* dst, const char* src, size_t size) {
+    size_t head = std::min(size, size_t(-reinterpret_cast<uintptr_t>(dst) & 31));
+    std::memcpy(dst, src, head);
+    dst += head; src += head; size -= head;
+    for (; size >= 128; dst += 128, src += 128, size -= 128) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 32));
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 64));
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 96));
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(dst),      a);
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + 32), b);
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + 64), c);
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + 96), d);
+    }
+    _mm_sfence();
+    std::memcpy(dst, src, size);
+}
+
+ANYDSL_TARGET("avx512f")
+static void stream_copy_avx512(char* dst, const char* src, size_t size) {
+    size_t head = std::min(size, size_t(-reinterpret_cast<uintptr_t>(dst) & 63));
+    std::memcpy(dst, src, head);
+    dst += head; src += head; size -= head;
+    for (; size >= 256; dst += 256, src += 256, size -= 256) {
+        __m512i a = _mm512_loadu_si512(src);
+        __m512i b = _mm512_loadu_si512(src + 64);
+        __m512i c = _mm512_loadu_si512(src + 128);
+        __m512i d = _mm512_loadu_si512(src + 192);
+        _mm512_stream_si512(reinterpret_cast<__m512i*>(dst),       a);
+        _mm512_stream_si512(reinterpret_cast<__m512i*>(dst + 64),  b);
+        _mm512_stream_si512(reinterpret_cast<__m512i*>(dst + 128), c);
+        _mm512_stream_si512(reinterpret_cast<__m512i*>(dst + 192), d);
+    }
+    _mm_sfence();
+    std::memcpy(dst, src, size);
+}
+#endif
+
+static CopyFn select_stream_copy() {
+#ifdef ANYDSL_COPY_X86
+#if defined(__GNUC__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return stream_copy_avx512;
+    if (__builtin_cpu_supports("avx2"))
+        return stream_copy_avx2;
+#endif
+    return stream_copy_sse2;
+#else
+    return copy_memcpy;
+#endif
+}
+
+static size_t last_level_cache_size() {
+#if defined(_SC_LEVEL3_CACHE_SIZE)
+    long size = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    if (size > 0)
+        return size_t(size);
+#endif
+    // Assume a large cache when the size is unknown, so that streaming stores are only used for very large copies
+    return 32 << 20;
+}
+
+struct ParallelCopy {
+    char* dst;
+    const char* src;
+    size_t size;
+    CopyFn fn;
+};
+
+static void run_copy_chunks(void* data, int64_t begin, int64_t end) {
+    auto copy = static_cast<ParallelCopy*>(data);
+    size_t first = size_t(begin) * copy_chunk_size;
+    size_t last  = std::min(size_t(end) * copy_chunk_size, copy->size);
+    copy->fn(copy->dst + first, copy->src + first, last - first);
+}
+
+void cpu_copy(void* dst, const void* src, size_t size, int32_t node) {
+    if (size < parallel_copy_size) {
+        std::memcpy(dst, src, size);
+        return;
+    }
+
+    static const CopyFn stream_copy = select_stream_copy();
+    static const size_t cache_size = last_level_cache_size();
+
+    // Copies that fit in the cache are likely to be read again soon, keep them there
+    ParallelCopy copy = { static_cast<char*>(dst), static_cast<const char*>(src), size, size > cache_size ? stream_copy : copy_memcpy };
+    int64_t num_chunks = int64_t((size + copy_chunk_size - 1) / copy_chunk_size);
+    if (node >= 0) {
+        int32_t num_threads = int32_t(std::min<int64_t>(num_chunks, numa_nodes()[node].cpus.size()));
+        ThreadPool::instance().parallel_for_node(size_t(node), num_threads, 0, num_chunks, run_copy_chunks, &copy);
+        return;
+    }
+    int32_t num_threads = int32_t(std::min<int64_t>(num_chunks, ThreadPool::resolve_threads(0)));
+    ThreadPool::instance().parallel_for(num_threads, 0, num_chunks, run_copy_chunks, &copy);
+}
@@ -0,0 +1,13 @@
+#ifndef CPU_COPY_H
+#define CPU_COPY_H
+
+#include <cstddef>
+#include <cstdint>
+
+/// Copies `size` bytes between host buffers. Large copies are split across the threads
+/// of the pool, and copies that do not fit in the last-level cache use non-temporal stores,
+/// selected at runtime among the SSE2, AVX2 and AVX-512 variants supported by the CPU.
+/// If `node` is not negative, large copies run on the CPUs of that NUMA node (index in `numa_nodes()`).
+void cpu_copy(void* dst, const void* src, size_t size, int32_t node = -1);
+
+#endif
@@ -1,10 +1,15 @@
 #include "cpu_platform.h"
 #include "runtime.h"
+#include "thread_pool.h"
+#include "futex.h"
 
 #include <cstddef>
 #include <algorithm>
+#include <atomic>
+#include <deque>
 #include <fstream>
 #include <iterator>
+#include <mutex>
 #include <string>
 
 #if defined(__APPLE__)
@@ -68,4 +73,120 @@ CpuPlatform::CpuPlatform(Runtime* runtime)
     std::search(std::istreambuf_iterator<char>(cpuinfo), {}, model_string.begin(), model_string.end());
     std::getline(cpuinfo >> std::ws, device_name_);
     #endif
+
+    for (auto& node : numa_nodes())
+        node_names_.push_back(device_name_ + " (NUMA node " + std::to_string(node.id) + ")");
+}
+
+struct CpuEvent {
+    std::atomic<int32_t> done { 0 };
+};
+
+// The operations of a stream are queued and drained by a single task of the thread pool,
+// which is submitted again whenever the queue becomes non-empty. Events are markers in the queue.
+struct CpuStream {
+    struct Op {
+        void* dst;
+        const void* src;
+        int64_t size;
+        int32_t node;
+        CpuEvent* event;    ///< Set for markers, which complete the event instead of copying
+    };
+
+    std::mutex lock;
+    std::deque<Op> ops;
+    bool running = false;
+    TaskGroup tasks;
+};
+
+static void complete(CpuEvent* event) {
+    event->done.store(1);
+    futex_wake(event->done);
+}
+
+static void drain_stream(void* data, int64_t, int64_t) {
+    auto stream = static_cast<CpuStream*>(data);
+    while (true) {
+        CpuStream::Op op;
+        {
+            std::lock_guard<std::mutex> guard(stream->lock);
+            if (stream->ops.empty()) {
+                stream->running = false;
+                return;
+            }
+            op = stream->ops.front();
+            stream->ops.pop_front();
+        }
+        if (op.event)
+            complete(op.event);
+        else
+            cpu_copy(op.dst, op.src, op.size, op.node);
+    }
+}
+
+static void push_op(CpuStream* stream, const CpuStream::Op& op) {
+    std::lock_guard<std::mutex> guard(stream->lock);
+    stream->ops.push_back(op);
+    if (!stream->running) {
+        stream->running = true;
+        ThreadPool::instance().submit(stream->tasks, drain_stream, stream, 0, 0);
+    }
+}
+
+void* CpuPlatform::create_stream(DeviceId) {
+    return new CpuStream();
+}
+
+void CpuPlatform::destroy_stream(DeviceId dev, void* stream) {
+    synchronize_stream(dev, stream);
+    auto cpu_stream = static_cast<CpuStream*>(stream);
+    // The drain task may still be returning after completing the last marker
+    ThreadPool::instance().wait(cpu_stream->tasks);
+    delete cpu_stream;
+}
+
+void CpuPlatform::copy_async(DeviceId dev_src, const void* src, int64_t offset_src,
+                             DeviceId dev_dst, void* dst, int64_t offset_dst, int64_t size, void* stream) {
+    push_op(static_cast<CpuStream*>(stream), CpuStream::Op {
+        (char*)dst + offset_dst, (const char*)src + offset_src, size, dev_dst != 0 ? node(dev_dst) : node(dev_src), nullptr });
+}
+
+void CpuPlatform::copy_from_host_async(const void* src, int64_t offset_src, DeviceId dev_dst,
+                                       void* dst, int64_t offset_dst, int64_t size, void* stream) {
+    push_op(static_cast<CpuStream*>(stream), CpuStream::Op {
+        (char*)dst + offset_dst, (const char*)src + offset_src, size, node(dev_dst), nullptr });
+}
+
+void CpuPlatform::copy_to_host_async(DeviceId dev_src, const void* src, int64_t offset_src,
+                                     void* dst, int64_t offset_dst, int64_t size, void* stream) {
+    push_op(static_cast<CpuStream*>(stream), CpuStream::Op {
+        (char*)dst + offset_dst, (const char*)src + offset_src, size, node(dev_src), nullptr });
+}
+
+void* CpuPlatform::record_event(DeviceId, void* stream) {
+    auto cpu_stream = static_cast<CpuStream*>(stream);
+    auto event = new CpuEvent();
+    std::lock_guard<std::mutex> guard(cpu_stream->lock);
+    // An idle stream has completed all its operations
+    if (cpu_stream->running)
+        cpu_stream->ops.push_back(CpuStream::Op { nullptr, nullptr, 0, -1, event });
+    else
+        event->done.store(1);
+    return event;
+}
+
+void CpuPlatform::wait_event(DeviceId, void* event) {
+    auto cpu_event = static_cast<CpuEvent*>(event);
+    if (!cpu_event->done.load()) {
+        auto& pool = ThreadPool::instance();
+        pool.block_begin();
+        while (!cpu_event->done.load())
+            futex_wait(cpu_event->done, 0);
+        pool.block_end();
+    }
+    delete cpu_event;
+}
+
+void CpuPlatform::synchronize_stream(DeviceId dev, void* stream) {
+    wait_event(dev, record_event(dev, stream));
 }
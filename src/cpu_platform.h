@@ -2,37 +2,63 @@
 #define CPU_PLATFORM_H
 
 #include "platform.h"
+#include "cpu_alloc.h"
+#include "cpu_copy.h"
+#include "numa.h"
 
 #ifndef PAGE_SIZE
 #define PAGE_SIZE 4096
 #endif
 
 #include <cstring>
+#include <string>
+#include <vector>
 
 /// CPU platform, allocation is guaranteed to be aligned to page size: 4096 bytes.
+/// Memory goes through the caching allocator, which recycles released blocks,
+/// and may be backed by huge pages (see `ANYDSL_ALLOC_HUGE_PAGES` and `ANYDSL_HUGE_PAGES`).
+/// Device 0 is the whole machine, devices 1 to N are the NUMA nodes: their memory is bound
+/// to the node, and copies to (or from) their memory run on the CPUs of the node.
+/// The copies submitted to a stream run in order on a worker of the thread pool.
 class CpuPlatform : public Platform {
 public:
     CpuPlatform(Runtime* runtime);
 
+    /// Returns the NUMA node (index in `numa_nodes()`) of a device, or -1 for device 0.
+    static int32_t node(DeviceId dev) { return int32_t(dev) - 1; }
+
 protected:
-    void* alloc(DeviceId, int64_t size) override {
-        return Runtime::aligned_malloc(size, 32);
+    void* alloc(DeviceId dev, int64_t size) override {
+        return CpuAllocator::instance().alloc(size, 32, false, node(dev));
+    }
+
+    void* alloc_host(DeviceId dev, int64_t size) override {
+        return CpuAllocator::instance().alloc(size, PAGE_SIZE, false, node(dev));
+    }
+
+    void* alloc_unified(DeviceId dev, int64_t size) override {
+        return CpuAllocator::instance().alloc(size, PAGE_SIZE, false, node(dev));
     }
 
-    void* alloc_host(DeviceId, int64_t size) override {
-        return Runtime::aligned_malloc(size, PAGE_SIZE);
+    void* alloc_ex(DeviceId dev, int64_t size, int32_t flags) override {
+        size_t alignment = (flags & ANYDSL_ALLOC_KIND_MASK) == ANYDSL_ALLOC_DEVICE ? 32 : PAGE_SIZE;
+        return CpuAllocator::instance().alloc(size, alignment, (flags & ANYDSL_ALLOC_HUGE_PAGES) != 0, node(dev));
     }
 
-    void* alloc_unified(DeviceId, int64_t size) override {
-        return Runtime::aligned_malloc(size, PAGE_SIZE);
+    int32_t page_kind(DeviceId, void* ptr) override {
+        return ptr ? int32_t(CpuAllocator::pages(ptr)) : ANYDSL_PAGES_DEFAULT;
     }
 
     void* get_device_ptr(DeviceId, void* ptr) override {
         return ptr;
     }
 
+    void* map_host(DeviceId, void* ptr, int64_t, bool) override {
+        return ptr;
+    }
+
     void release(DeviceId, void* ptr) override {
-        Runtime::aligned_free(ptr);
+        CpuAllocator::instance().release(ptr);
     }
 
     void release_host(DeviceId dev, void* ptr) override {
@@ -46,27 +72,41 @@ protected:
     void launch_kernel(DeviceId, const LaunchParams&) override { no_kernel(); }
     void synchronize(DeviceId) override { no_kernel(); }
 
-    void copy(const void* src, int64_t offset_src, void* dst, int64_t offset_dst, int64_t size) {
-        memcpy((char*)dst + offset_dst, (char*)src + offset_src, size);
+    // Copies run on the node of the destination, so that the pages are written by local CPUs
+    void copy(const void* src, int64_t offset_src, void* dst, int64_t offset_dst, int64_t size, int32_t node = -1) {
+        cpu_copy((char*)dst + offset_dst, (char*)src + offset_src, size, node);
     }
 
-    void copy(DeviceId, const void* src, int64_t offset_src,
-              DeviceId, void* dst, int64_t offset_dst, int64_t size) override {
-        copy(src, offset_src, dst, offset_dst, size);
+    void copy(DeviceId dev_src, const void* src, int64_t offset_src,
+              DeviceId dev_dst, void* dst, int64_t offset_dst, int64_t size) override {
+        copy(src, offset_src, dst, offset_dst, size, dev_dst != 0 ? node(dev_dst) : node(dev_src));
     }
-    void copy_from_host(const void* src, int64_t offset_src, DeviceId,
+    void copy_from_host(const void* src, int64_t offset_src, DeviceId dev_dst,
                         void* dst, int64_t offset_dst, int64_t size) override {
-        copy(src, offset_src, dst, offset_dst, size);
+        copy(src, offset_src, dst, offset_dst, size, node(dev_dst));
     }
-    void copy_to_host(DeviceId, const void* src, int64_t offset_src,
+    void copy_to_host(DeviceId dev_src, const void* src, int64_t offset_src,
                       void* dst, int64_t offset_dst, int64_t size) override {
-        copy(src, offset_src, dst, offset_dst, size);
+        copy(src, offset_src, dst, offset_dst, size, node(dev_src));
     }
 
+    void* create_stream(DeviceId dev) override;
+    void destroy_stream(DeviceId dev, void* stream) override;
+    void copy_async(DeviceId dev_src, const void* src, int64_t offset_src,
+                    DeviceId dev_dst, void* dst, int64_t offset_dst, int64_t size, void* stream) override;
+    void copy_from_host_async(const void* src, int64_t offset_src, DeviceId dev_dst,
+                              void* dst, int64_t offset_dst, int64_t size, void* stream) override;
+    void copy_to_host_async(DeviceId dev_src, const void* src, int64_t offset_src,
+                            void* dst, int64_t offset_dst, int64_t size, void* stream) override;
+    void* record_event(DeviceId dev, void* stream) override;
+    void wait_event(DeviceId dev, void* event) override;
+    void synchronize_stream(DeviceId dev, void* stream) override;
+
     std::string device_name_;
-    size_t dev_count() const override { return 1; }
+    std::vector<std::string> node_names_;
+    size_t dev_count() const override { return 1 + numa_nodes().size(); }
     std::string name() const override { return "CPU"; }
-    const char* device_name(DeviceId) const override { return device_name_.c_str(); }
+    const char* device_name(DeviceId dev) const override { return dev == 0 ? device_name_.c_str() : node_names_[node(dev)].c_str(); }
     bool device_check_feature_support(DeviceId, const char*) const override { return false; }
 };
 
@@ -18,6 +18,7 @@ protected:
     void* alloc_host(DeviceId, int64_t) override { platform_error(); }
     void* alloc_unified(DeviceId, int64_t) override { platform_error(); }
     void* get_device_ptr(DeviceId, void*) override { platform_error(); }
+    void* map_host(DeviceId, void*, int64_t, bool) override { platform_error(); }
     void release(DeviceId, void*) override { platform_error(); }
     void release_host(DeviceId, void*) override { platform_error(); }
 
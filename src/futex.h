@@ -0,0 +1,66 @@
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include <atomic>
+#include <climits>
+#include <cstdint>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <condition_variable>
+#include <mutex>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/// Hints the processor that the calling thread is spinning.
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+#if defined(__linux__)
+/// Blocks the calling thread as long as `word` holds `expected`. May return spuriously.
+inline void futex_wait(std::atomic<int32_t>& word, int32_t expected) {
+    syscall(SYS_futex, reinterpret_cast<int32_t*>(&word), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+}
+
+/// Wakes up to `count` threads blocked on `word`.
+inline void futex_wake(std::atomic<int32_t>& word, int32_t count = INT_MAX) {
+    syscall(SYS_futex, reinterpret_cast<int32_t*>(&word), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+}
+#else
+// Without futexes, all the waiters share a condition variable and every wake-up notifies all of them
+struct FutexTable {
+    std::mutex lock;
+    std::condition_variable cond;
+
+    static FutexTable& instance() {
+        static FutexTable table;
+        return table;
+    }
+};
+
+inline void futex_wait(std::atomic<int32_t>& word, int32_t expected) {
+    auto& table = FutexTable::instance();
+    std::unique_lock<std::mutex> lock(table.lock);
+    if (word.load() == expected)
+        table.cond.wait(lock);
+}
+
+inline void futex_wake(std::atomic<int32_t>&, int32_t = INT_MAX) {
+    auto& table = FutexTable::instance();
+    std::lock_guard<std::mutex> lock(table.lock);
+    table.cond.notify_all();
+}
+#endif
+
+#endif
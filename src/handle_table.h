@@ -0,0 +1,117 @@
+#ifndef HANDLE_TABLE_H
+#define HANDLE_TABLE_H
+
+#include <atomic>
+#include <cstdint>
+
+/// Lock-free table of objects referenced by integer handles.
+/// A handle combines a slot index with the generation of the slot: releasing a
+/// handle bumps the generation, so that stale copies of the handle are detected.
+/// Slots are allocated in pages that are never freed before the table itself,
+/// and objects are reused by later handles instead of being destroyed.
+template <typename T>
+class HandleTable {
+public:
+    static constexpr int32_t index_bits = 16;
+    static constexpr int32_t max_handles = 1 << index_bits;
+
+    HandleTable() : free_(0), size_(0) {
+        for (auto& page : pages_)
+            page = nullptr;
+    }
+
+    ~HandleTable() {
+        for (auto& page : pages_)
+            delete[] page.load();
+    }
+
+    HandleTable(const HandleTable&) = delete;
+    HandleTable& operator = (const HandleTable&) = delete;
+
+    /// Allocates a slot and returns its handle, or -1 if the table is full.
+    int32_t acquire() {
+        uint32_t index;
+        if (!pop_free(index)) {
+            index = size_.fetch_add(1);
+            if (index >= uint32_t(max_handles)) {
+                size_.fetch_sub(1);
+                return -1;
+            }
+        }
+        return int32_t((slot(index).generation.load(std::memory_order_acquire) & generation_mask) << index_bits | index);
+    }
+
+    /// Returns the object of a handle, or nullptr if the handle is invalid or has been released.
+    T* get(int32_t handle) {
+        if (handle < 0)
+            return nullptr;
+        uint32_t index = uint32_t(handle) & (max_handles - 1);
+        if (index >= size_.load(std::memory_order_acquire) || !pages_[index >> page_bits].load(std::memory_order_acquire))
+            return nullptr;
+        Slot& s = slot(index);
+        if ((s.generation.load(std::memory_order_acquire) & generation_mask) != uint32_t(handle) >> index_bits)
+            return nullptr;
+        return &s.value;
+    }
+
+    /// Frees the slot of a handle. The handle and all its copies become invalid.
+    void release(int32_t handle) {
+        uint32_t index = uint32_t(handle) & (max_handles - 1);
+        Slot& s = slot(index);
+        s.generation.fetch_add(1, std::memory_order_acq_rel);
+        push_free(index);
+    }
+
+private:
+    static constexpr int32_t page_bits = 10;
+    static constexpr int32_t num_pages = max_handles >> page_bits;
+    static constexpr uint32_t generation_mask = (1u << (31 - index_bits)) - 1;
+
+    struct Slot {
+        T value;
+        std::atomic<uint32_t> generation { 0 };
+        std::atomic<uint32_t> next { 0 };
+    };
+
+    Slot& slot(uint32_t index) {
+        auto& page = pages_[index >> page_bits];
+        Slot* slots = page.load(std::memory_order_acquire);
+        if (!slots) {
+            // The first user of a page allocates it, concurrent users keep the winner
+            Slot* fresh = new Slot[1 << page_bits];
+            if (page.compare_exchange_strong(slots, fresh, std::memory_order_acq_rel))
+                slots = fresh;
+            else
+                delete[] fresh;
+        }
+        return slots[index & ((1 << page_bits) - 1)];
+    }
+
+    // The free list is a stack whose head packs a tag (against ABA) with the index + 1 of the top slot
+    bool pop_free(uint32_t& index) {
+        uint64_t head = free_.load(std::memory_order_acquire);
+        while (uint32_t(head) != 0) {
+            uint32_t top = uint32_t(head) - 1;
+            uint64_t next = (head & ~uint64_t(0xFFFFFFFF)) + (uint64_t(1) << 32) + slot(top).next.load(std::memory_order_relaxed);
+            if (free_.compare_exchange_weak(head, next, std::memory_order_acq_rel)) {
+                index = top;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void push_free(uint32_t index) {
+        Slot& s = slot(index);
+        uint64_t head = free_.load(std::memory_order_relaxed);
+        do {
+            s.next.store(uint32_t(head), std::memory_order_relaxed);
+        } while (!free_.compare_exchange_weak(head, ((head & ~uint64_t(0xFFFFFFFF)) + (uint64_t(1) << 32)) | (index + 1), std::memory_order_acq_rel));
+    }
+
+    std::atomic<Slot*> pages_[num_pages];
+    std::atomic<uint64_t> free_;
+    std::atomic<uint32_t> size_;
+};
+
+#endif
@@ -0,0 +1,160 @@
+#include "numa.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Parses CPU lists of the form "0-3,8,10-11"
+static std::vector<int32_t> parse_cpu_list(const std::string& list) {
+    std::vector<int32_t> cpus;
+    std::stringstream stream(list);
+    std::string range;
+    while (std::getline(stream, range, ',')) {
+        if (range.empty() || !std::isdigit(range[0]))
+            continue;
+        auto dash = range.find('-');
+        int32_t first = std::stoi(range.substr(0, dash));
+        int32_t last  = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        for (int32_t cpu = first; cpu <= last; ++cpu)
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+static std::vector<NumaNode> detect_numa_nodes() {
+    std::vector<NumaNode> nodes;
+#ifdef __linux__
+    if (DIR* dir = opendir("/sys/devices/system/node")) {
+        while (auto entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name.compare(0, 4, "node") != 0 || name.size() == 4 || !std::isdigit(name[4]))
+                continue;
+            std::ifstream cpulist("/sys/devices/system/node/" + name + "/cpulist");
+            std::string list;
+            if (!cpulist || !std::getline(cpulist, list))
+                continue;
+            NumaNode node { std::stoi(name.substr(4)), parse_cpu_list(list) };
+            // Memory-only nodes cannot run threads
+            if (!node.cpus.empty())
+                nodes.push_back(node);
+        }
+        closedir(dir);
+    }
+#endif
+    if (nodes.empty()) {
+        NumaNode node { 0, {} };
+        int32_t num_cpus = std::max(1u, std::thread::hardware_concurrency());
+        for (int32_t cpu = 0; cpu < num_cpus; ++cpu)
+            node.cpus.push_back(cpu);
+        nodes.push_back(node);
+    }
+    std::sort(nodes.begin(), nodes.end(), [] (const NumaNode& a, const NumaNode& b) { return a.id < b.id; });
+    return nodes;
+}
+
+const std::vector<NumaNode>& numa_nodes() {
+    static const std::vector<NumaNode> nodes = detect_numa_nodes();
+    return nodes;
+}
+
+const std::vector<int32_t>& numa_cpus() {
+    static const std::vector<int32_t> cpus = [] {
+        std::vector<int32_t> cpus;
+        for (auto& node : numa_nodes())
+            cpus.insert(cpus.end(), node.cpus.begin(), node.cpus.end());
+        return cpus;
+    }();
+    return cpus;
+}
+
+bool numa_enabled_by_env() {
+    const char* env_var = std::getenv("ANYDSL_NUMA");
+    return env_var && std::strcmp(env_var, "0") != 0;
+}
+
+#ifdef __linux__
+// Affinity of the process when the runtime is loaded, which honours the restrictions of taskset or cgroups
+static cpu_set_t initial_affinity() {
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) != 0 || CPU_COUNT(&set) == 0) {
+        CPU_ZERO(&set);
+        for (auto cpu : numa_cpus())
+            CPU_SET(cpu, &set);
+    }
+    return set;
+}
+
+static const cpu_set_t process_affinity = initial_affinity();
+
+static bool set_affinity(pthread_t thread, int32_t cpu) {
+    cpu_set_t set = process_affinity;
+    if (cpu >= 0) {
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+    }
+    return pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+}
+
+bool pin_thread(std::thread& thread, int32_t cpu) { return set_affinity(thread.native_handle(), cpu); }
+bool pin_current_thread(int32_t cpu) { return set_affinity(pthread_self(), cpu); }
+
+// Affinities saved by `bind_current_thread()`, restored in reverse order
+static thread_local std::vector<cpu_set_t> saved_affinities;
+
+bool bind_current_thread(size_t node) {
+    cpu_set_t saved;
+    if (pthread_getaffinity_np(pthread_self(), sizeof(saved), &saved) != 0)
+        saved = process_affinity;
+    saved_affinities.push_back(saved);
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (auto cpu : numa_nodes()[node].cpus)
+        CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+void unbind_current_thread() {
+    if (saved_affinities.empty())
+        return;
+    cpu_set_t saved = saved_affinities.back();
+    saved_affinities.pop_back();
+    pthread_setaffinity_np(pthread_self(), sizeof(saved), &saved);
+}
+
+bool bind_memory(void* ptr, size_t size, size_t node) {
+    // Page-aligned range covering [ptr, ptr + size)
+    uintptr_t page_mask = uintptr_t(sysconf(_SC_PAGESIZE)) - 1;
+    uintptr_t begin = reinterpret_cast<uintptr_t>(ptr) & ~page_mask;
+    uintptr_t end = (reinterpret_cast<uintptr_t>(ptr) + size + page_mask) & ~page_mask;
+    int32_t id = numa_nodes()[node].id;
+    std::vector<unsigned long> mask(id / (8 * sizeof(unsigned long)) + 1, 0);
+    mask[id / (8 * sizeof(unsigned long))] = 1ul << (id % (8 * sizeof(unsigned long)));
+    return syscall(SYS_mbind, begin, end - begin, MPOL_BIND, mask.data(), mask.size() * 8 * sizeof(unsigned long) + 1, 0) == 0;
+}
+#else
+bool pin_thread(std::thread&, int32_t) { return false; }
+bool pin_current_thread(int32_t) { return false; }
+bool bind_current_thread(size_t) { return false; }
+void unbind_current_thread() {}
+bool bind_memory(void*, size_t, size_t) { return false; }
+#endif
+
+size_t numa_first_cpu(size_t node) {
+    size_t first = 0;
+    for (size_t i = 0; i < node; ++i)
+        first += numa_nodes()[i].cpus.size();
+    return first;
+}
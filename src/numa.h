@@ -0,0 +1,41 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+/// A NUMA node and the logical CPUs that belong to it.
+struct NumaNode {
+    int32_t id;
+    std::vector<int32_t> cpus;
+};
+
+/// Returns the NUMA nodes of the machine, as reported by `/sys/devices/system/node`.
+/// Systems without NUMA information are described as a single node holding all the CPUs.
+const std::vector<NumaNode>& numa_nodes();
+/// Returns the logical CPUs of the machine, grouped by NUMA node.
+const std::vector<int32_t>& numa_cpus();
+
+/// Returns true if NUMA mode is requested through the `ANYDSL_NUMA` environment variable.
+bool numa_enabled_by_env();
+
+/// Restricts the given thread to a logical CPU, or to the CPUs the process was allowed to run on
+/// when the runtime was loaded if `cpu` is negative.
+/// Returns false if thread affinity is not supported on this system.
+bool pin_thread(std::thread& thread, int32_t cpu);
+/// Restricts the calling thread to a logical CPU, or to the CPUs of the process if `cpu` is negative.
+bool pin_current_thread(int32_t cpu);
+
+/// Returns the position of the first CPU of a node (index in `numa_nodes()`) in `numa_cpus()`.
+size_t numa_first_cpu(size_t node);
+/// Restricts the calling thread to the CPUs of a node (index in `numa_nodes()`) until the matching
+/// `unbind_current_thread()`, which restores the previous affinity. Bindings can be nested.
+bool bind_current_thread(size_t node);
+void unbind_current_thread();
+
+/// Binds the pages of a memory range, which must not be touched yet, to a node (index in `numa_nodes()`).
+/// Returns false if memory policies are not supported on this system.
+bool bind_memory(void* ptr, size_t size, size_t node);
+
+#endif
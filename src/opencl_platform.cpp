@@ -211,25 +211,7 @@ OpenCLPlatform::OpenCLPlatform(Runtime* runtime)
             CHECK_OPENCL(err, "clCreateContext()");
 
             // create command queue
-            devices_[dev].queue = NULL;
-            #ifdef CL_VERSION_2_0
-            if (version_major >= 2) {
-                cl_queue_properties queue_props[3] = { 0, 0, 0 };
-                if (runtime_->profiling_enabled()) {
-                    queue_props[0] = CL_QUEUE_PROPERTIES;
-                    queue_props[1] = CL_QUEUE_PROFILING_ENABLE;
-                }
-                devices_[dev].queue = clCreateCommandQueueWithProperties(devices_[dev].ctx, devices_[dev].dev, queue_props, &err);
-                CHECK_OPENCL(err, "clCreateCommandQueueWithProperties()");
-            }
-            #endif
-            if (!devices_[dev].queue) {
-                cl_command_queue_properties queue_props = 0;
-                if (runtime_->profiling_enabled())
-                    queue_props = CL_QUEUE_PROFILING_ENABLE;
-                devices_[dev].queue = clCreateCommandQueue(devices_[dev].ctx, devices_[dev].dev, queue_props, &err);
-                CHECK_OPENCL(err, "clCreateCommandQueue()");
-            }
+            devices_[dev].queue = create_queue(DeviceId(dev));
 
             if (platform_name.find("FPGA") != std::string::npos) {
                 devices_[dev].is_intel_fpga = true;
@@ -334,6 +316,80 @@ void* OpenCLPlatform::alloc_unified(DeviceId dev, int64_t size) {
     error("clSVMAlloc() requires at least OpenCL 2.0 for OpenCL device %", dev);
 }
 
+void* OpenCLPlatform::map_host(DeviceId dev, void* ptr, int64_t size, bool read_only) {
+    #ifdef CL_VERSION_2_0
+    if (devices_[dev].version_major == 2) {
+        // Kernels take SVM pointers, which can only point to any host memory with fine-grained system SVM
+        if (devices_[dev].svm_caps & CL_DEVICE_SVM_FINE_GRAIN_SYSTEM)
+            return ptr;
+        error("Host memory cannot be used directly by OpenCL device % without fine-grained system SVM", dev);
+    }
+    #endif
+    // Devices that share the host memory (e.g. CPUs) access the buffer in place, others may cache it
+    cl_int err = CL_SUCCESS;
+    cl_mem_flags flags = (read_only ? CL_MEM_READ_ONLY : CL_MEM_READ_WRITE) | CL_MEM_USE_HOST_PTR;
+    cl_mem mem = clCreateBuffer(devices_[dev].ctx, flags, size, ptr, &err);
+    CHECK_OPENCL(err, "clCreateBuffer()");
+
+    return (void*)mem;
+}
+
+void OpenCLPlatform::unmap_host(DeviceId dev, void* ptr) {
+    #ifdef CL_VERSION_2_0
+    if (devices_[dev].version_major == 2)
+        return;
+    #endif
+    // Devices that cache a CL_MEM_USE_HOST_PTR buffer only write it back to the host memory
+    // when it is mapped, which must happen before the buffer is released
+    cl_mem mem = (cl_mem)ptr;
+    cl_mem_flags mem_flags = 0;
+    cl_int err = clGetMemObjectInfo(mem, CL_MEM_FLAGS, sizeof(mem_flags), &mem_flags, NULL);
+    CHECK_OPENCL(err, "clGetMemObjectInfo()");
+    if (!(mem_flags & CL_MEM_READ_ONLY)) {
+        synchronize(dev);
+        size_t size = 0;
+        err = clGetMemObjectInfo(mem, CL_MEM_SIZE, sizeof(size), &size, NULL);
+        CHECK_OPENCL(err, "clGetMemObjectInfo()");
+        void* host = clEnqueueMapBuffer(devices_[dev].queue, mem, CL_TRUE, CL_MAP_READ, 0, size, 0, NULL, NULL, &err);
+        CHECK_OPENCL(err, "clEnqueueMapBuffer()");
+        err = clEnqueueUnmapMemObject(devices_[dev].queue, mem, host, 0, NULL, NULL);
+        err |= clFinish(devices_[dev].queue);
+        CHECK_OPENCL(err, "clEnqueueUnmapMemObject()");
+    }
+    err = clReleaseMemObject(mem);
+    CHECK_OPENCL(err, "clReleaseMemObject()");
+}
+
+void* OpenCLPlatform::sub_buffer(DeviceId dev, void* buffer, int64_t offset, int64_t size) {
+    #ifdef CL_VERSION_2_0
+    if (devices_[dev].version_major == 2)
+        return static_cast<char*>(buffer) + offset;
+    #endif
+    cl_int err = CL_SUCCESS;
+    cl_buffer_region region = { size_t(offset), size_t(size) };
+    cl_mem mem = clCreateSubBuffer((cl_mem)buffer, CL_MEM_READ_WRITE, CL_BUFFER_CREATE_TYPE_REGION, &region, &err);
+    CHECK_OPENCL(err, "clCreateSubBuffer()");
+
+    return (void*)mem;
+}
+
+bool OpenCLPlatform::sub_buffers_need_release(DeviceId dev) const {
+    #ifdef CL_VERSION_2_0
+    if (devices_[dev].version_major == 2)
+        return false;
+    #endif
+    unused(dev);
+    return true;
+}
+
+int64_t OpenCLPlatform::sub_buffer_alignment(DeviceId dev) const {
+    // Sub-buffers must start on an address aligned to CL_DEVICE_MEM_BASE_ADDR_ALIGN (in bits)
+    cl_uint align_bits = 0;
+    cl_int err = clGetDeviceInfo(devices_[dev].dev, CL_DEVICE_MEM_BASE_ADDR_ALIGN, sizeof(align_bits), &align_bits, NULL);
+    CHECK_OPENCL(err, "clGetDeviceInfo()");
+    return std::max(int64_t(1), int64_t(align_bits / 8));
+}
+
 void OpenCLPlatform::release(DeviceId dev, void* ptr) {
     #ifdef CL_VERSION_2_0
     if (devices_[dev].version_major == 2)
@@ -491,6 +547,134 @@ void OpenCLPlatform::copy_svm(const void* src, int64_t offset_src, void* dst, in
     std::copy((char*)src + offset_src, (char*)src + offset_src + size, (char*)dst + offset_dst);
 }
 
+cl_command_queue OpenCLPlatform::create_queue(DeviceId dev) {
+    cl_int err = CL_SUCCESS;
+    #ifdef CL_VERSION_2_0
+    if (devices_[dev].version_major >= 2) {
+        cl_queue_properties queue_props[3] = { 0, 0, 0 };
+        if (runtime_->profiling_enabled()) {
+            queue_props[0] = CL_QUEUE_PROPERTIES;
+            queue_props[1] = CL_QUEUE_PROFILING_ENABLE;
+        }
+        cl_command_queue queue = clCreateCommandQueueWithProperties(devices_[dev].ctx, devices_[dev].dev, queue_props, &err);
+        CHECK_OPENCL(err, "clCreateCommandQueueWithProperties()");
+        return queue;
+    }
+    #endif
+    cl_command_queue_properties queue_props = 0;
+    if (runtime_->profiling_enabled())
+        queue_props = CL_QUEUE_PROFILING_ENABLE;
+    cl_command_queue queue = clCreateCommandQueue(devices_[dev].ctx, devices_[dev].dev, queue_props, &err);
+    CHECK_OPENCL(err, "clCreateCommandQueue()");
+    return queue;
+}
+
+// Streams are in-order queues of their own, so that copies overlap with the kernels of the main queue
+void* OpenCLPlatform::create_stream(DeviceId dev) {
+    return (void*)create_queue(dev);
+}
+
+void OpenCLPlatform::destroy_stream(DeviceId dev, void* stream) {
+    synchronize_stream(dev, stream);
+    cl_int err = clReleaseCommandQueue((cl_command_queue)stream);
+    CHECK_OPENCL(err, "clReleaseCommandQueue()");
+}
+
+// Returns an event that completes with the commands already in the main queue of the device.
+// Copies on a stream wait for it, so that they see the results of the kernels launched before them.
+cl_event OpenCLPlatform::queue_marker(DeviceId dev) {
+    cl_event marker;
+    cl_int err = clEnqueueMarkerWithWaitList(devices_[dev].queue, 0, NULL, &marker);
+    err |= clFlush(devices_[dev].queue);
+    CHECK_OPENCL(err, "clEnqueueMarkerWithWaitList()");
+    return marker;
+}
+
+void OpenCLPlatform::copy_async(DeviceId dev_src, const void* src, int64_t offset_src, DeviceId dev_dst, void* dst, int64_t offset_dst, int64_t size, void* stream) {
+    assert(dev_src == dev_dst);
+    unused(dev_dst);
+
+    cl_event marker = queue_marker(dev_src);
+    cl_int err = CL_SUCCESS;
+    #ifdef CL_VERSION_2_0
+    if (devices_[dev_src].version_major == 2) {
+        err = clEnqueueSVMMemcpy((cl_command_queue)stream, CL_FALSE, (char*)dst + offset_dst, (char*)src + offset_src, size, 1, &marker, NULL);
+        err |= clFlush((cl_command_queue)stream);
+        err |= clReleaseEvent(marker);
+        CHECK_OPENCL(err, "clEnqueueSVMMemcpy()");
+        return;
+    }
+    #endif
+    err = clEnqueueCopyBuffer((cl_command_queue)stream, (cl_mem)src, (cl_mem)dst, offset_src, offset_dst, size, 1, &marker, NULL);
+    err |= clFlush((cl_command_queue)stream);
+    err |= clReleaseEvent(marker);
+    CHECK_OPENCL(err, "clEnqueueCopyBuffer()");
+}
+
+void OpenCLPlatform::copy_from_host_async(const void* src, int64_t offset_src, DeviceId dev_dst, void* dst, int64_t offset_dst, int64_t size, void* stream) {
+    cl_event marker = queue_marker(dev_dst);
+    cl_int err = CL_SUCCESS;
+    #ifdef CL_VERSION_2_0
+    if (devices_[dev_dst].version_major == 2) {
+        err = clEnqueueSVMMemcpy((cl_command_queue)stream, CL_FALSE, (char*)dst + offset_dst, (char*)src + offset_src, size, 1, &marker, NULL);
+        err |= clFlush((cl_command_queue)stream);
+        err |= clReleaseEvent(marker);
+        CHECK_OPENCL(err, "clEnqueueSVMMemcpy()");
+        return;
+    }
+    #endif
+    err = clEnqueueWriteBuffer((cl_command_queue)stream, (cl_mem)dst, CL_FALSE, offset_dst, size, (char*)src + offset_src, 1, &marker, NULL);
+    err |= clFlush((cl_command_queue)stream);
+    err |= clReleaseEvent(marker);
+    CHECK_OPENCL(err, "clEnqueueWriteBuffer()");
+}
+
+void OpenCLPlatform::copy_to_host_async(DeviceId dev_src, const void* src, int64_t offset_src, void* dst, int64_t offset_dst, int64_t size, void* stream) {
+    cl_event marker = queue_marker(dev_src);
+    cl_int err = CL_SUCCESS;
+    #ifdef CL_VERSION_2_0
+    if (devices_[dev_src].version_major == 2) {
+        err = clEnqueueSVMMemcpy((cl_command_queue)stream, CL_FALSE, (char*)dst + offset_dst, (char*)src + offset_src, size, 1, &marker, NULL);
+        err |= clFlush((cl_command_queue)stream);
+        err |= clReleaseEvent(marker);
+        CHECK_OPENCL(err, "clEnqueueSVMMemcpy()");
+        return;
+    }
+    #endif
+    err = clEnqueueReadBuffer((cl_command_queue)stream, (cl_mem)src, CL_FALSE, offset_src, size, (char*)dst + offset_dst, 1, &marker, NULL);
+    err |= clFlush((cl_command_queue)stream);
+    err |= clReleaseEvent(marker);
+    CHECK_OPENCL(err, "clEnqueueReadBuffer()");
+}
+
+void* OpenCLPlatform::record_event(DeviceId dev, void* stream) {
+    unused(dev);
+    cl_event event;
+    cl_int err = clEnqueueMarkerWithWaitList((cl_command_queue)stream, 0, NULL, &event);
+    err |= clFlush((cl_command_queue)stream);
+    CHECK_OPENCL(err, "clEnqueueMarkerWithWaitList()");
+    return (void*)event;
+}
+
+void OpenCLPlatform::wait_event(DeviceId dev, void* event) {
+    unused(dev);
+    cl_int err = clWaitForEvents(1, (cl_event*)&event);
+    err |= clReleaseEvent((cl_event)event);
+    CHECK_OPENCL(err, "clWaitForEvents()");
+}
+
+void OpenCLPlatform::device_wait_event(DeviceId dev, void* event) {
+    cl_int err = clEnqueueBarrierWithWaitList(devices_[dev].queue, 1, (cl_event*)&event, NULL);
+    err |= clFlush(devices_[dev].queue);
+    CHECK_OPENCL(err, "clEnqueueBarrierWithWaitList()");
+}
+
+void OpenCLPlatform::synchronize_stream(DeviceId dev, void* stream) {
+    unused(dev);
+    cl_int err = clFinish((cl_command_queue)stream);
+    CHECK_OPENCL(err, "clFinish()");
+}
+
 static std::string program_as_string(cl_program program) {
     size_t binary_size;
     cl_int err = clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &binary_size, NULL);
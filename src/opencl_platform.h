@@ -28,6 +28,12 @@ protected:
     void* alloc_host(DeviceId, int64_t) override { command_unavailable("alloc_host"); }
     void* alloc_unified(DeviceId, int64_t) override;
     void* get_device_ptr(DeviceId, void*) override { command_unavailable("get_device_ptr"); }
+    void* map_host(DeviceId dev, void* ptr, int64_t size, bool read_only) override;
+    void unmap_host(DeviceId dev, void* ptr) override;
+    void* sub_buffer(DeviceId dev, void* buffer, int64_t offset, int64_t size) override;
+    void release_sub_buffer(DeviceId dev, void* ptr) override { release(dev, ptr); }
+    bool sub_buffers_need_release(DeviceId dev) const override;
+    int64_t sub_buffer_alignment(DeviceId dev) const override;
     void release(DeviceId dev, void* ptr) override;
     void release_host(DeviceId, void*) override { command_unavailable("release_host"); }
 
@@ -38,6 +44,18 @@ protected:
     void copy_from_host(const void* src, int64_t offset_src, DeviceId dev_dst, void* dst, int64_t offset_dst, int64_t size) override;
     void copy_to_host(DeviceId dev_src, const void* src, int64_t offset_src, void* dst, int64_t offset_dst, int64_t size) override;
     void copy_svm(const void* src, int64_t offset_src, void* dst, int64_t offset_dst, int64_t size);
+
+    void* create_stream(DeviceId dev) override;
+    void destroy_stream(DeviceId dev, void* stream) override;
+    void copy_async(DeviceId dev_src, const void* src, int64_t offset_src, DeviceId dev_dst, void* dst, int64_t offset_dst, int64_t size, void* stream) override;
+    void copy_from_host_async(const void* src, int64_t offset_src, DeviceId dev_dst, void* dst, int64_t offset_dst, int64_t size, void* stream) override;
+    void copy_to_host_async(DeviceId dev_src, const void* src, int64_t offset_src, void* dst, int64_t offset_dst, int64_t size, void* stream) override;
+    void* record_event(DeviceId dev, void* stream) override;
+    void wait_event(DeviceId dev, void* event) override;
+    void device_wait_event(DeviceId dev, void* event) override;
+    void synchronize_stream(DeviceId dev, void* stream) override;
+    cl_event queue_marker(DeviceId dev);
+    cl_command_queue create_queue(DeviceId dev);
     void dynamic_profile(DeviceId dev, const std::string& filename);
 
     size_t dev_count() const override { return devices_.size(); }
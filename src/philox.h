@@ -0,0 +1,42 @@
+#ifndef PHILOX_H
+#define PHILOX_H
+
+#include <cstdint>
+
+/// Philox4x32-10 counter-based generator (Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3").
+/// Every 128-bit counter is mapped to four independent 32-bit random numbers, so any element of
+/// a random sequence can be computed directly from its index, in any order and on any thread.
+/// The artic implementation in runtime.impala produces the same numbers.
+namespace philox {
+
+static constexpr uint32_t M0 = 0xD2511F53;
+static constexpr uint32_t M1 = 0xCD9E8D57;
+static constexpr uint32_t W0 = 0x9E3779B9;
+static constexpr uint32_t W1 = 0xBB67AE85;
+static constexpr int rounds = 10;
+
+inline void round(uint32_t ctr[4], uint32_t k0, uint32_t k1) {
+    uint64_t p0 = uint64_t(M0) * ctr[0];
+    uint64_t p1 = uint64_t(M1) * ctr[2];
+    uint32_t c0 = uint32_t(p1 >> 32) ^ ctr[1] ^ k0;
+    uint32_t c2 = uint32_t(p0 >> 32) ^ ctr[3] ^ k1;
+    ctr[1] = uint32_t(p1);
+    ctr[3] = uint32_t(p0);
+    ctr[0] = c0;
+    ctr[2] = c2;
+}
+
+/// Computes the four random numbers of the given counter in place.
+inline void generate(uint32_t ctr[4], uint32_t k0, uint32_t k1) {
+    for (int i = 0; i < rounds; ++i, k0 += W0, k1 += W1)
+        round(ctr, k0, k1);
+}
+
+/// Converts a random number to a float in [0, 1), using the 24 most significant bits.
+inline float to_float(uint32_t x) {
+    return float(x >> 8) * (1.0f / 16777216.0f);
+}
+
+} // namespace philox
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef PLATFORM_H
 #define PLATFORM_H
 
+#include "anydsl_runtime.h"
 #include "anydsl_runtime_config.h"
 #include "log.h"
 #include "runtime.h"
@@ -31,6 +32,29 @@ public:
     virtual void* alloc_host(DeviceId dev, int64_t size) = 0;
     /// Allocates unified memory for a platform (and a device).
     virtual void* alloc_unified(DeviceId dev, int64_t size) = 0;
+    /// Allocates memory of the kind given by the `ANYDSL_ALLOC_*` flags. The other flags are hints, ignored by default.
+    virtual void* alloc_ex(DeviceId dev, int64_t size, int32_t flags) {
+        switch (flags & ANYDSL_ALLOC_KIND_MASK) {
+            case ANYDSL_ALLOC_HOST:    return alloc_host(dev, size);
+            case ANYDSL_ALLOC_UNIFIED: return alloc_unified(dev, size);
+            default:                   return alloc(dev, size);
+        }
+    }
+    /// Returns the kind of pages backing the given memory (see `ANYDSL_PAGES_*`).
+    virtual int32_t page_kind(DeviceId, void*) { return ANYDSL_PAGES_DEFAULT; }
+    /// Returns a buffer of the device that uses the given host memory directly, without copying it.
+    virtual void* map_host(DeviceId, void*, int64_t, bool /* read_only */) { command_unavailable("map_host"); }
+    /// Releases a buffer obtained from `map_host()`. Writes of the device to the buffer are visible in the host memory afterwards.
+    virtual void unmap_host(DeviceId, void*) {}
+    /// Returns a buffer for `size` bytes at `offset` in a buffer of the device, sharing its memory.
+    /// By default, sub-buffers are addresses in the buffer.
+    virtual void* sub_buffer(DeviceId, void* buffer, int64_t offset, int64_t /* size */) { return static_cast<char*>(buffer) + offset; }
+    /// Releases a buffer obtained from `sub_buffer()`, if sub-buffers need to be released on this device.
+    virtual void release_sub_buffer(DeviceId, void*) {}
+    /// Returns true if sub-buffers are objects of their own, that must be released with `release_sub_buffer()`.
+    virtual bool sub_buffers_need_release(DeviceId) const { return false; }
+    /// Returns the alignment required for the offsets of sub-buffers.
+    virtual int64_t sub_buffer_alignment(DeviceId) const { return 1; }
     /// Returns the device memory associated with the page-locked memory.
     virtual void* get_device_ptr(DeviceId dev, void* ptr) = 0;
     /// Releases memory for a device on this platform.
@@ -50,6 +74,33 @@ public:
     /// Copies memory to the host (CPU).
     virtual void copy_to_host(DeviceId dev_src, const void* src, int64_t offset_src, void* dst, int64_t offset_dst, int64_t size) = 0;
 
+    /// Creates a stream of the device. The operations of a stream run in order, asynchronously with the host.
+    /// By default, streams are null and the operations submitted to them run synchronously.
+    virtual void* create_stream(DeviceId) { return nullptr; }
+    /// Waits for the operations of a stream and destroys it.
+    virtual void destroy_stream(DeviceId, void*) {}
+    /// Like `copy()`, but submitted to a stream. The memory must stay valid until the copy has completed.
+    virtual void copy_async(DeviceId dev_src, const void* src, int64_t offset_src, DeviceId dev_dst, void* dst, int64_t offset_dst, int64_t size, void* /* stream */) {
+        copy(dev_src, src, offset_src, dev_dst, dst, offset_dst, size);
+    }
+    /// Like `copy_from_host()`, but submitted to a stream. The memory must stay valid until the copy has completed.
+    virtual void copy_from_host_async(const void* src, int64_t offset_src, DeviceId dev_dst, void* dst, int64_t offset_dst, int64_t size, void* /* stream */) {
+        copy_from_host(src, offset_src, dev_dst, dst, offset_dst, size);
+    }
+    /// Like `copy_to_host()`, but submitted to a stream. The memory must stay valid until the copy has completed.
+    virtual void copy_to_host_async(DeviceId dev_src, const void* src, int64_t offset_src, void* dst, int64_t offset_dst, int64_t size, void* /* stream */) {
+        copy_to_host(dev_src, src, offset_src, dst, offset_dst, size);
+    }
+    /// Returns an event that completes once the operations submitted to the stream so far have completed.
+    virtual void* record_event(DeviceId, void* /* stream */) { return nullptr; }
+    /// Waits for an event obtained from `record_event()`, and releases it.
+    virtual void wait_event(DeviceId, void*) {}
+    /// Makes the operations submitted to the device after this call wait for an event obtained from
+    /// `record_event()`, without blocking the host. The event is not released.
+    virtual void device_wait_event(DeviceId, void*) {}
+    /// Waits for all the operations submitted to a stream.
+    virtual void synchronize_stream(DeviceId, void*) {}
+
     /// Returns the platform name.
     virtual std::string name() const = 0;
     /// Returns the number of devices in this platform.
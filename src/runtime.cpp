@@ -4,10 +4,18 @@
 #include "anydsl_runtime.h"
 
 #include "runtime.h"
+#include "alloc_tracker.h"
 #include "platform.h"
 #include "dummy_platform.h"
 #include "cpu_platform.h"
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #ifndef AnyDSL_runtime_HAS_CUDA_SUPPORT
 void register_cuda_platform(Runtime* runtime) { runtime->register_platform<DummyPlatform>("CUDA"); }
 #endif
@@ -27,8 +35,11 @@ void register_levelzero_platform(Runtime* runtime) { runtime->register_platform<
 Runtime::Runtime(std::pair<ProfileLevel, ProfileLevel> profile)
     : profile_(profile)
     , cache_dir_("")
+    , tracker_(AllocTracker::enabled_by_env() ? new AllocTracker() : nullptr)
 {}
 
+Runtime::~Runtime() {}
+
 void Runtime::display_info() const {
     info("Available platforms:");
     for (auto& p: platforms_) {
@@ -48,19 +59,41 @@ bool Runtime::device_check_feature_support(PlatformId plat, DeviceId dev, const
     return platforms_[plat]->device_check_feature_support(dev, feature);
 }
 
-void* Runtime::alloc(PlatformId plat, DeviceId dev, int64_t size) {
+void* Runtime::alloc(PlatformId plat, DeviceId dev, int64_t size, void* caller) {
     check_device(plat, dev);
-    return platforms_[plat]->alloc(dev, size);
+    void* ptr = platforms_[plat]->alloc(dev, size);
+    if (tracker_)
+        tracker_->record_alloc(plat, dev, ptr, size, caller);
+    return ptr;
 }
 
-void* Runtime::alloc_host(PlatformId plat, DeviceId dev, int64_t size) {
+void* Runtime::alloc_host(PlatformId plat, DeviceId dev, int64_t size, void* caller) {
     check_device(plat, dev);
-    return platforms_[plat]->alloc_host(dev, size);
+    void* ptr = platforms_[plat]->alloc_host(dev, size);
+    if (tracker_)
+        tracker_->record_alloc(plat, dev, ptr, size, caller);
+    return ptr;
 }
 
-void* Runtime::alloc_unified(PlatformId plat, DeviceId dev, int64_t size) {
+void* Runtime::alloc_unified(PlatformId plat, DeviceId dev, int64_t size, void* caller) {
     check_device(plat, dev);
-    return platforms_[plat]->alloc_unified(dev, size);
+    void* ptr = platforms_[plat]->alloc_unified(dev, size);
+    if (tracker_)
+        tracker_->record_alloc(plat, dev, ptr, size, caller);
+    return ptr;
+}
+
+void* Runtime::alloc_ex(PlatformId plat, DeviceId dev, int64_t size, int32_t flags, void* caller) {
+    check_device(plat, dev);
+    void* ptr = platforms_[plat]->alloc_ex(dev, size, flags);
+    if (tracker_)
+        tracker_->record_alloc(plat, dev, ptr, size, caller);
+    return ptr;
+}
+
+int32_t Runtime::page_kind(PlatformId plat, DeviceId dev, void* ptr) {
+    check_device(plat, dev);
+    return platforms_[plat]->page_kind(dev, ptr);
 }
 
 void* Runtime::get_device_ptr(PlatformId plat, DeviceId dev, void* ptr) {
@@ -70,14 +103,38 @@ void* Runtime::get_device_ptr(PlatformId plat, DeviceId dev, void* ptr) {
 
 void Runtime::release(PlatformId plat, DeviceId dev, void* ptr) {
     check_device(plat, dev);
+    if (tracker_)
+        tracker_->record_release(plat, dev, ptr);
     platforms_[plat]->release(dev, ptr);
 }
 
 void Runtime::release_host(PlatformId plat, DeviceId dev, void* ptr) {
     check_device(plat, dev);
+    if (tracker_)
+        tracker_->record_release(plat, dev, ptr);
     platforms_[plat]->release_host(dev, ptr);
 }
 
+void* Runtime::sub_buffer(PlatformId plat, DeviceId dev, void* buffer, int64_t offset, int64_t size) {
+    check_device(plat, dev);
+    return platforms_[plat]->sub_buffer(dev, buffer, offset, size);
+}
+
+void Runtime::release_sub_buffer(PlatformId plat, DeviceId dev, void* ptr) {
+    check_device(plat, dev);
+    platforms_[plat]->release_sub_buffer(dev, ptr);
+}
+
+bool Runtime::sub_buffers_need_release(PlatformId plat, DeviceId dev) const {
+    check_device(plat, dev);
+    return platforms_[plat]->sub_buffers_need_release(dev);
+}
+
+int64_t Runtime::sub_buffer_alignment(PlatformId plat, DeviceId dev) const {
+    check_device(plat, dev);
+    return platforms_[plat]->sub_buffer_alignment(dev);
+}
+
 void Runtime::copy(
     PlatformId plat_src, DeviceId dev_src, const void* src, int64_t offset_src,
     PlatformId plat_dst, DeviceId dev_dst, void* dst, int64_t offset_dst, int64_t size) {
@@ -103,6 +160,63 @@ void Runtime::copy(
     }
 }
 
+void* Runtime::create_stream(PlatformId plat, DeviceId dev) {
+    check_device(plat, dev);
+    return platforms_[plat]->create_stream(dev);
+}
+
+void Runtime::destroy_stream(PlatformId plat, DeviceId dev, void* stream) {
+    check_device(plat, dev);
+    platforms_[plat]->destroy_stream(dev, stream);
+}
+
+void Runtime::copy_async(
+    PlatformId plat_src, DeviceId dev_src, const void* src, int64_t offset_src,
+    PlatformId plat_dst, DeviceId dev_dst, void* dst, int64_t offset_dst, int64_t size,
+    PlatformId plat_stream, DeviceId dev_stream, void* stream) {
+    check_device(plat_src, dev_src);
+    check_device(plat_dst, dev_dst);
+    // Same dispatch as copy(): the copy is done by the platform that is not the host, if any
+    bool to_device = plat_src == 0 && plat_dst != 0;
+    PlatformId plat = to_device ? plat_dst : plat_src;
+    DeviceId dev = to_device ? dev_dst : dev_src;
+    if (plat_stream != plat || dev_stream != dev)
+        error("Copies from platform %, device % to platform %, device % need a stream of platform %, device %", plat_src, dev_src, plat_dst, dev_dst, plat, dev);
+
+    if (plat_src == plat_dst) {
+        platforms_[plat_src]->copy_async(dev_src, src, offset_src, dev_dst, dst, offset_dst, size, stream);
+        debug("Asynchronous copy between devices % and % on platform %", dev_src, dev_dst, plat_src);
+    } else if (plat_src == 0) {
+        platforms_[plat_dst]->copy_from_host_async(src, offset_src, dev_dst, dst, offset_dst, size, stream);
+        debug("Asynchronous copy from host to device % on platform %", dev_dst, plat_dst);
+    } else if (plat_dst == 0) {
+        platforms_[plat_src]->copy_to_host_async(dev_src, src, offset_src, dst, offset_dst, size, stream);
+        debug("Asynchronous copy to host from device % on platform %", dev_src, plat_src);
+    } else {
+        error("Cannot copy memory between different platforms");
+    }
+}
+
+void* Runtime::record_event(PlatformId plat, DeviceId dev, void* stream) {
+    check_device(plat, dev);
+    return platforms_[plat]->record_event(dev, stream);
+}
+
+void Runtime::wait_event(PlatformId plat, DeviceId dev, void* event) {
+    check_device(plat, dev);
+    platforms_[plat]->wait_event(dev, event);
+}
+
+void Runtime::device_wait_event(PlatformId plat, DeviceId dev, void* event) {
+    check_device(plat, dev);
+    platforms_[plat]->device_wait_event(dev, event);
+}
+
+void Runtime::synchronize_stream(PlatformId plat, DeviceId dev, void* stream) {
+    check_device(plat, dev);
+    platforms_[plat]->synchronize_stream(dev, stream);
+}
+
 void Runtime::launch_kernel(PlatformId plat, DeviceId dev, const LaunchParams& launch_params) {
     check_device(plat, dev);
     assert(launch_params.grid[0] > 0 && launch_params.grid[0] % launch_params.block[0] == 0 &&
@@ -117,6 +231,73 @@ void Runtime::synchronize(PlatformId plat, DeviceId dev) {
     platforms_[plat]->synchronize(dev);
 }
 
+void* Runtime::map_file(PlatformId plat, DeviceId dev, const char* path, int64_t offset, int64_t size, int32_t flags) {
+    check_device(plat, dev);
+#if defined(__unix__) || defined(__APPLE__)
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        error("Can't open mapped file '%'", path);
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        error("Can't open mapped file '%'", path);
+    }
+    int64_t file_size = file_stat.st_size;
+    if (size <= 0)
+        size = file_size - offset;
+    if (offset < 0 || size <= 0 || offset + size > file_size) {
+        close(fd);
+        error("Invalid range [%, %) for mapped file '%' of % bytes", offset, offset + size, path, file_size);
+    }
+
+    // Mappings start on a page boundary
+    int64_t skip = offset % int64_t(sysconf(_SC_PAGESIZE));
+    size_t length = size_t(skip + size);
+    int prot = PROT_READ | (flags & ANYDSL_MAP_PRIVATE ? PROT_WRITE : 0);
+    int map_flags = MAP_PRIVATE;
+#if defined(MAP_POPULATE)
+    if (flags & ANYDSL_MAP_POPULATE)
+        map_flags |= MAP_POPULATE;
+#else
+    if (flags & ANYDSL_MAP_POPULATE)
+        flags |= ANYDSL_MAP_WILLNEED;
+#endif
+    void* base = mmap(nullptr, length, prot, map_flags, fd, offset - skip);
+    close(fd);
+    if (base == MAP_FAILED)
+        error("Can't map file '%'", path);
+    if (flags & ANYDSL_MAP_SEQUENTIAL)
+        madvise(base, length, MADV_SEQUENTIAL);
+    if (flags & ANYDSL_MAP_WILLNEED)
+        madvise(base, length, MADV_WILLNEED);
+
+    void* ptr = platforms_[plat]->map_host(dev, static_cast<char*>(base) + skip, size, !(flags & ANYDSL_MAP_PRIVATE));
+    std::lock_guard<std::mutex> guard(mappings_lock_);
+    mappings_[ptr] = FileMapping { base, length };
+    return ptr;
+#else
+    unused(path, offset, size, flags);
+    error("Memory-mapped files are not supported on this system");
+#endif
+}
+
+void Runtime::unmap(PlatformId plat, DeviceId dev, void* ptr) {
+    check_device(plat, dev);
+    FileMapping mapping;
+    {
+        std::lock_guard<std::mutex> guard(mappings_lock_);
+        auto it = mappings_.find(ptr);
+        if (it == mappings_.end())
+            error("Buffer % is not a mapped file", ptr);
+        mapping = it->second;
+        mappings_.erase(it);
+    }
+    platforms_[plat]->unmap_host(dev, ptr);
+#if defined(__unix__) || defined(__APPLE__)
+    munmap(mapping.base, mapping.length);
+#endif
+}
+
 #ifdef _WIN32
 #include <direct.h>
 #define PATH_DIR_SEPARATOR '\\'
@@ -10,6 +10,7 @@
 #include <vector>
 #include <atomic>
 #include <memory>
+#include <mutex>
 
 #include "log.h"
 
@@ -18,6 +19,7 @@ enum PlatformId : uint32_t {};
 enum class ProfileLevel : uint8_t { None = 0, Full, Fpga_dynamic };
 
 class Platform;
+class AllocTracker;
 
 enum class KernelArgType : uint8_t { Val = 0, Ptr, Struct };
 
@@ -42,6 +44,7 @@ struct LaunchParams {
 class Runtime {
 public:
     Runtime(std::pair<ProfileLevel, ProfileLevel>);
+    ~Runtime();
 
     /// Registers the given platform into the runtime.
     template <typename T, typename... Args>
@@ -57,12 +60,29 @@ public:
     /// Checks whether feature is supported on device.
     bool device_check_feature_support(PlatformId, DeviceId, const char*) const;
 
-    /// Allocates memory on the given device.
-    void* alloc(PlatformId plat, DeviceId dev, int64_t size);
+    /// Allocates memory on the given device. The `caller` is recorded as the call site when allocations are tracked.
+    void* alloc(PlatformId plat, DeviceId dev, int64_t size, void* caller = nullptr);
     /// Allocates page-locked memory on the given platform and device.
-    void* alloc_host(PlatformId plat, DeviceId dev, int64_t size);
+    void* alloc_host(PlatformId plat, DeviceId dev, int64_t size, void* caller = nullptr);
     /// Allocates unified memory on the given platform and device.
-    void* alloc_unified(PlatformId plat, DeviceId dev, int64_t size);
+    void* alloc_unified(PlatformId plat, DeviceId dev, int64_t size, void* caller = nullptr);
+    /// Allocates memory of the kind given by the `ANYDSL_ALLOC_*` flags on the given platform and device.
+    void* alloc_ex(PlatformId plat, DeviceId dev, int64_t size, int32_t flags, void* caller = nullptr);
+    /// Returns the kind of pages backing the given memory (see `ANYDSL_PAGES_*`).
+    int32_t page_kind(PlatformId plat, DeviceId dev, void* ptr);
+    /// Maps `size` bytes of a file, starting at `offset`, in memory (see `ANYDSL_MAP_*`), and returns a buffer of the given device that uses the mapping.
+    /// The mapping extends to the end of the file if `size` is not positive.
+    void* map_file(PlatformId plat, DeviceId dev, const char* path, int64_t offset, int64_t size, int32_t flags);
+    /// Releases a buffer obtained from `map_file()` and unmaps the file.
+    void unmap(PlatformId plat, DeviceId dev, void* ptr);
+    /// Returns a buffer for `size` bytes at `offset` in a buffer of the given device, sharing its memory.
+    void* sub_buffer(PlatformId plat, DeviceId dev, void* buffer, int64_t offset, int64_t size);
+    /// Releases a buffer obtained from `sub_buffer()`.
+    void release_sub_buffer(PlatformId plat, DeviceId dev, void* ptr);
+    /// Returns true if the sub-buffers of the given device must be released with `release_sub_buffer()`.
+    bool sub_buffers_need_release(PlatformId plat, DeviceId dev) const;
+    /// Returns the alignment required for the offsets of sub-buffers on the given device.
+    int64_t sub_buffer_alignment(PlatformId plat, DeviceId dev) const;
     /// Returns the device memory associated with the page-locked memory.
     void* get_device_ptr(PlatformId plat, DeviceId dev, void* ptr);
     /// Releases memory.
@@ -74,6 +94,28 @@ public:
         PlatformId plat_src, DeviceId dev_src, const void* src, int64_t offset_src,
         PlatformId plat_dst, DeviceId dev_dst, void* dst, int64_t offset_dst, int64_t size);
 
+    /// Returns the allocation tracker, or nullptr if allocations are not tracked (see `ANYDSL_TRACK_ALLOC`).
+    AllocTracker* alloc_tracker() { return tracker_.get(); }
+
+    /// Creates a stream on the given platform and device (see `Platform::create_stream()`).
+    void* create_stream(PlatformId plat, DeviceId dev);
+    /// Waits for the operations of a stream and destroys it.
+    void destroy_stream(PlatformId plat, DeviceId dev, void* stream);
+    /// Copies memory between devices asynchronously. The stream must belong to the device that performs the copy:
+    /// the source device, unless the source is on the host and the destination is not.
+    void copy_async(
+        PlatformId plat_src, DeviceId dev_src, const void* src, int64_t offset_src,
+        PlatformId plat_dst, DeviceId dev_dst, void* dst, int64_t offset_dst, int64_t size,
+        PlatformId plat_stream, DeviceId dev_stream, void* stream);
+    /// Returns an event that completes once the operations submitted to the stream so far have completed.
+    void* record_event(PlatformId plat, DeviceId dev, void* stream);
+    /// Waits for an event and releases it.
+    void wait_event(PlatformId plat, DeviceId dev, void* event);
+    /// Makes the operations submitted to the device after this call wait for an event, without blocking the host.
+    void device_wait_event(PlatformId plat, DeviceId dev, void* event);
+    /// Waits for all the operations submitted to a stream.
+    void synchronize_stream(PlatformId plat, DeviceId dev, void* stream);
+
     /// Launches a kernel on the platform and device.
     void launch_kernel(PlatformId plat, DeviceId dev, const LaunchParams& launch_params);
     /// Waits for the completion of all kernels on the given platform and device.
@@ -111,6 +153,14 @@ private:
     std::vector<std::unique_ptr<Platform>> platforms_;
     std::unordered_map<std::string, std::string> files_;
     std::string cache_dir_;
+
+    struct FileMapping {
+        void* base;
+        size_t length;
+    };
+    std::unordered_map<void*, FileMapping> mappings_; ///< File mappings, indexed by the buffers returned by `map_file()`
+    std::mutex mappings_lock_;
+    std::unique_ptr<AllocTracker> tracker_;
 };
 
 #endif
@@ -0,0 +1,514 @@
+#include "thread_pool.h"
+#include "numa.h"
+
+#include <algorithm>
+
+static thread_local int32_t worker_index = -1;
+static thread_local int32_t task_depth = 0;
+
+// Number of unsuccessful attempts at finding a task before a thread goes to sleep
+static constexpr int spin_count = 64;
+
+static std::atomic<size_t> worker_limit(0);
+
+ThreadPool& ThreadPool::instance() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::set_worker_limit(size_t limit) {
+    worker_limit = limit;
+}
+
+ThreadPool::ThreadPool()
+    : num_detached_(0)
+    , running_detached_(0)
+    , num_workers_(0)
+    , limit_(worker_limit > 0 ? std::min(worker_limit.load(), max_workers) : max_workers)
+    , next_worker_(0)
+    , queued_(0)
+    , sleepers_(0)
+    , blocked_(0)
+    , stop_(false)
+    , numa_(false)
+    , blocked_waiters_(0)
+{
+    numa_ = numa_enabled_by_env();
+    reserve(resolve_threads(0));
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        stop_ = true;
+        sleep_cond_.notify_all();
+    }
+    for (size_t i = 0, n = num_workers(); i < n; ++i)
+        workers_[i]->thread.join();
+}
+
+int32_t ThreadPool::resolve_threads(int32_t num_threads) {
+    if (num_threads <= 0) {
+        num_threads = std::thread::hardware_concurrency();
+        // hardware_concurrency is implementation defined, may return 0
+        num_threads = (num_threads == 0) ? 1 : num_threads;
+    }
+    return num_threads;
+}
+
+int32_t ThreadPool::current_worker() {
+    return worker_index;
+}
+
+bool ThreadPool::in_task() {
+    return task_depth > 0;
+}
+
+void ThreadPool::reserve(size_t count) {
+    grow(std::min(count, limit_ + blocked_.load()));
+}
+
+void ThreadPool::grow(size_t count) {
+    count = std::min(count, max_workers);
+    if (num_workers() >= count)
+        return;
+
+    std::lock_guard<std::mutex> lock(grow_mutex_);
+    for (size_t i = num_workers(); i < count; ++i) {
+        workers_[i].reset(new Worker());
+        workers_[i]->thread = std::thread([this, i] { worker_main(int32_t(i)); });
+        if (numa())
+            pin_worker(i);
+        // Publish the worker only once it is fully constructed
+        num_workers_.store(i + 1, std::memory_order_release);
+    }
+}
+
+void ThreadPool::pin_worker(size_t index) {
+    // Workers are spread over the CPUs in node order, so that consecutive workers share a node
+    auto& cpus = numa_cpus();
+    pin_thread(workers_[index]->thread, numa() ? cpus[index % cpus.size()] : -1);
+}
+
+void ThreadPool::set_numa(bool enable) {
+    std::lock_guard<std::mutex> lock(grow_mutex_);
+    numa_ = enable;
+    for (size_t i = 0, n = num_workers(); i < n; ++i)
+        pin_worker(i);
+}
+
+void ThreadPool::push_task(int32_t index, const Task& task, bool pinned) {
+    Worker& worker = *workers_[index];
+    {
+        std::lock_guard<std::mutex> lock(worker.lock);
+        (pinned ? worker.pinned : worker.tasks).push_back(task);
+    }
+    if (pinned)
+        worker.num_pinned.fetch_add(1);
+    else
+        queued_.fetch_add(1);
+    if (sleepers_.load() > 0) {
+        // Pinned tasks must wake up their worker, not just any sleeping thread
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        if (pinned)
+            sleep_cond_.notify_all();
+        else
+            sleep_cond_.notify_one();
+    }
+}
+
+void ThreadPool::submit(TaskGroup& group, TaskFn fn, void* data, int64_t begin, int64_t end, int32_t worker, bool pinned) {
+    if (worker < 0)
+        worker = worker_index;
+    if (worker < 0)
+        worker = int32_t(next_worker_.fetch_add(1, std::memory_order_relaxed) % num_workers());
+    retain(group);
+    push_task(worker, Task { fn, data, begin, end, &group }, pinned);
+}
+
+void ThreadPool::submit_detached(TaskGroup& group, TaskFn fn, void* data, int64_t begin, int64_t end) {
+    retain(group);
+    {
+        std::lock_guard<std::mutex> lock(detached_lock_);
+        detached_.push_back(Task { fn, data, begin, end, &group, true });
+    }
+    num_detached_.fetch_add(1);
+    // Every detached task gets a worker of its own, as a detached task may wait for another one to start
+    grow(size_t(running_detached_.load() + num_detached_.load()));
+    if (sleepers_.load() > 0) {
+        // Threads waiting inside a task cannot run detached tasks, wake up every thread
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        sleep_cond_.notify_all();
+    }
+}
+
+bool ThreadPool::pop_pinned_task(int32_t index, Task& task) {
+    Worker& worker = *workers_[index];
+    if (worker.num_pinned.load(std::memory_order_relaxed) == 0)
+        return false;
+    std::lock_guard<std::mutex> lock(worker.lock);
+    if (worker.pinned.empty())
+        return false;
+    task = worker.pinned.front();
+    worker.pinned.pop_front();
+    worker.num_pinned.fetch_sub(1);
+    return true;
+}
+
+bool ThreadPool::pop_task(int32_t index, Task& task) {
+    Worker& worker = *workers_[index];
+    std::lock_guard<std::mutex> lock(worker.lock);
+    if (worker.tasks.empty())
+        return false;
+    task = worker.tasks.back();
+    worker.tasks.pop_back();
+    queued_.fetch_sub(1);
+    return true;
+}
+
+bool ThreadPool::steal_task(int32_t index, Task& task) {
+    size_t n = num_workers();
+    size_t start = index < 0 ? next_worker_.load(std::memory_order_relaxed) : size_t(index) + 1;
+    for (size_t i = 0; i < n; ++i) {
+        Worker& victim = *workers_[(start + i) % n];
+        std::unique_lock<std::mutex> lock(victim.lock, std::try_to_lock);
+        if (!lock.owns_lock() || victim.tasks.empty())
+            continue;
+        task = victim.tasks.front();
+        victim.tasks.pop_front();
+        queued_.fetch_sub(1);
+        return true;
+    }
+    return false;
+}
+
+bool ThreadPool::steal_pinned_task(int32_t index, Task& task) {
+    for (size_t i = 0, n = num_workers(); i < n; ++i) {
+        Worker& victim = *workers_[i];
+        if (int32_t(i) == index || victim.unavailable.load(std::memory_order_relaxed) == 0 || victim.num_pinned.load(std::memory_order_relaxed) == 0)
+            continue;
+        std::unique_lock<std::mutex> lock(victim.lock, std::try_to_lock);
+        if (!lock.owns_lock() || victim.pinned.empty())
+            continue;
+        task = victim.pinned.front();
+        victim.pinned.pop_front();
+        victim.num_pinned.fetch_sub(1);
+        return true;
+    }
+    return false;
+}
+
+bool ThreadPool::has_stealable_pinned() const {
+    for (size_t i = 0, n = num_workers(); i < n; ++i) {
+        if (workers_[i]->unavailable.load() > 0 && workers_[i]->num_pinned.load() > 0)
+            return true;
+    }
+    return false;
+}
+
+void ThreadPool::set_available(int32_t index, bool available) {
+    Worker& worker = *workers_[index];
+    if (available) {
+        worker.unavailable.fetch_sub(1);
+        return;
+    }
+    // The pinned tasks of the worker can now be stolen, wake up the threads that could take them
+    if (worker.unavailable.fetch_add(1) == 0 && worker.num_pinned.load() > 0 && sleepers_.load() > 0) {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        sleep_cond_.notify_all();
+    }
+}
+
+bool ThreadPool::pop_detached_task(Task& task) {
+    if (num_detached_.load(std::memory_order_relaxed) == 0)
+        return false;
+    std::lock_guard<std::mutex> lock(detached_lock_);
+    if (detached_.empty())
+        return false;
+    task = detached_.front();
+    detached_.pop_front();
+    // Count the task as running before it leaves the queue, so that `submit_detached()` never underestimates
+    running_detached_.fetch_add(1);
+    num_detached_.fetch_sub(1);
+    return true;
+}
+
+bool ThreadPool::find_task(int32_t index, Task& task, bool detached) {
+    if (index >= 0 && pop_pinned_task(index, task))
+        return true;
+    if (queued_.load(std::memory_order_relaxed) > 0 && ((index >= 0 && pop_task(index, task)) || steal_task(index, task)))
+        return true;
+    if (steal_pinned_task(index, task))
+        return true;
+    return detached && pop_detached_task(task);
+}
+
+bool ThreadPool::has_work(int32_t index, bool detached) const {
+    return queued_.load() > 0 || (index >= 0 && workers_[index]->num_pinned.load() > 0) || (detached && num_detached_.load() > 0) || has_stealable_pinned();
+}
+
+void ThreadPool::run_task(const Task& task) {
+    bool away = task.detached && worker_index >= 0;
+    if (away)
+        set_available(worker_index, false);
+    task_depth++;
+    task.fn(task.data, task.begin, task.end);
+    task_depth--;
+    if (away)
+        set_available(worker_index, true);
+    if (task.detached)
+        running_detached_.fetch_sub(1);
+    release(*task.group);
+}
+
+void ThreadPool::retain(TaskGroup& group) {
+    group.pending_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ThreadPool::release(TaskGroup& group) {
+    // The group may be destroyed by its owner as soon as the counter reaches zero
+    if (group.pending_.fetch_sub(1) == 1 && (sleepers_.load() > 0 || blocked_waiters_.load() > 0)) {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        sleep_cond_.notify_all();
+        blocked_cond_.notify_all();
+    }
+}
+
+void ThreadPool::block_begin() {
+    if (worker_index < 0)
+        return;
+    set_available(worker_index, false);
+    // Keep as many running workers as there are hardware threads, or as the limit allows
+    size_t blocked = blocked_.fetch_add(1) + 1;
+    size_t count = blocked + std::min(size_t(resolve_threads(0)), limit_);
+    if (num_workers() < count)
+        reserve(count);
+}
+
+void ThreadPool::block_end() {
+    if (worker_index < 0)
+        return;
+    blocked_.fetch_sub(1);
+    set_available(worker_index, true);
+}
+
+void ThreadPool::worker_main(int32_t index) {
+    worker_index = index;
+    Task task;
+    int spins = 0;
+    while (!stop_.load(std::memory_order_relaxed)) {
+        if (find_task(index, task, true)) {
+            run_task(task);
+            spins = 0;
+        } else if (++spins < spin_count) {
+            std::this_thread::yield();
+        } else {
+            std::unique_lock<std::mutex> lock(sleep_mutex_);
+            sleepers_.fetch_add(1);
+            sleep_cond_.wait(lock, [&] { return has_work(index, true) || stop_.load(); });
+            sleepers_.fetch_sub(1);
+            spins = 0;
+        }
+    }
+}
+
+void ThreadPool::wait(TaskGroup& group) {
+    // Detached tasks only start on idle workers: they may wait on anything, including the caller
+    Task task;
+    int spins = 0;
+    while (!group.finished()) {
+        if (find_task(worker_index, task, false)) {
+            run_task(task);
+            spins = 0;
+        } else if (++spins < spin_count) {
+            std::this_thread::yield();
+        } else {
+            // Sleep until either the group is finished or new tasks can be executed
+            std::unique_lock<std::mutex> lock(sleep_mutex_);
+            sleepers_.fetch_add(1);
+            sleep_cond_.wait(lock, [&] { return group.finished() || has_work(worker_index, false); });
+            sleepers_.fetch_sub(1);
+            spins = 0;
+        }
+    }
+}
+
+void ThreadPool::wait_blocked(TaskGroup& group) {
+    if (group.finished())
+        return;
+    block_begin();
+    {
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        blocked_waiters_.fetch_add(1);
+        blocked_cond_.wait(lock, [&] { return group.finished(); });
+        blocked_waiters_.fetch_sub(1);
+    }
+    block_end();
+}
+
+void ThreadPool::parallel_for(int32_t num_chunks, int64_t lower, int64_t upper, TaskFn fn, void* data) {
+    if (upper <= lower)
+        return;
+    // Nested loops share the workers of the enclosing loop: the pool does not grow
+    // and the chunks are queued on the current worker, where idle workers steal them
+    bool nested = in_task();
+    num_chunks = int32_t(std::min<int64_t>(num_chunks, upper - lower));
+    if (nested)
+        num_chunks = int32_t(std::min<size_t>(num_chunks, num_workers()));
+    if (num_chunks <= 1) {
+        fn(data, lower, upper);
+        return;
+    }
+
+    if (!nested)
+        reserve(num_chunks);
+
+    // Distribute the remainder over the first chunks
+    const int64_t linear = (upper - lower) / num_chunks;
+    const int64_t remainder = (upper - lower) % num_chunks;
+
+    // In NUMA mode, chunk i always goes to worker i: repeated loops over
+    // the same range touch the same memory from the same core
+    bool pinned = numa() && !nested;
+
+    TaskGroup group;
+    int64_t begin = lower;
+    for (int32_t i = 0; i < num_chunks; ++i) {
+        int64_t end = begin + linear + (i < remainder ? 1 : 0);
+        submit(group, fn, data, begin, end, pinned ? int32_t(i % num_workers()) : -1, pinned);
+        begin = end;
+    }
+    wait(group);
+}
+
+struct NodeLoop {
+    ThreadPool::TaskFn fn;
+    void* data;
+    size_t node;
+};
+
+static void run_node_chunk(void* data, int64_t begin, int64_t end) {
+    auto loop = static_cast<NodeLoop*>(data);
+    bind_current_thread(loop->node);
+    loop->fn(loop->data, begin, end);
+    unbind_current_thread();
+}
+
+void ThreadPool::parallel_for_node(size_t node, int32_t num_chunks, int64_t lower, int64_t upper, TaskFn fn, void* data) {
+    if (upper <= lower)
+        return;
+    size_t node_cpus = numa_nodes()[node].cpus.size();
+    size_t first_worker = numa_first_cpu(node);
+    if (num_chunks <= 0)
+        num_chunks = int32_t(node_cpus);
+    num_chunks = int32_t(std::min<int64_t>(num_chunks, upper - lower));
+
+    // In NUMA mode, workers are pinned in node order: the chunks go to the workers of the node.
+    // Otherwise, the threads running the chunks are moved to the node for the duration of each chunk.
+    bool nested = in_task();
+    bool pinned = numa() && !nested && first_worker + node_cpus <= max_workers;
+    NodeLoop loop = { fn, data, node };
+    if (num_chunks <= 1) {
+        run_node_chunk(&loop, lower, upper);
+        return;
+    }
+    if (pinned)
+        reserve(first_worker + node_cpus);
+    else if (!nested)
+        reserve(num_chunks);
+
+    const int64_t linear = (upper - lower) / num_chunks;
+    const int64_t remainder = (upper - lower) % num_chunks;
+
+    TaskGroup group;
+    int64_t begin = lower;
+    for (int32_t i = 0; i < num_chunks; ++i) {
+        int64_t end = begin + linear + (i < remainder ? 1 : 0);
+        if (pinned)
+            submit(group, fn, data, begin, end, int32_t(first_worker + i % node_cpus), true);
+        else
+            submit(group, run_node_chunk, &loop, begin, end);
+        begin = end;
+    }
+    wait(group);
+}
+
+struct ScheduledLoop {
+    ThreadPool::TaskFn fn;
+    void* data;
+    int64_t lower;
+    int64_t upper;
+    int64_t grain;
+    int64_t num_threads;
+    alignas(64) std::atomic<int64_t> next;
+};
+
+static void run_static_chunks(void* data, int64_t thread, int64_t) {
+    auto loop = static_cast<ScheduledLoop*>(data);
+    int64_t stride = loop->grain * loop->num_threads;
+    for (int64_t begin = loop->lower + thread * loop->grain; begin < loop->upper; begin += stride)
+        loop->fn(loop->data, begin, std::min(begin + loop->grain, loop->upper));
+}
+
+static void run_dynamic_chunks(void* data, int64_t, int64_t) {
+    auto loop = static_cast<ScheduledLoop*>(data);
+    int64_t begin;
+    while ((begin = loop->next.fetch_add(loop->grain, std::memory_order_relaxed)) < loop->upper)
+        loop->fn(loop->data, begin, std::min(begin + loop->grain, loop->upper));
+}
+
+static void run_guided_chunks(void* data, int64_t, int64_t) {
+    auto loop = static_cast<ScheduledLoop*>(data);
+    int64_t begin = loop->next.load(std::memory_order_relaxed);
+    while (begin < loop->upper) {
+        int64_t chunk = std::max(loop->grain, (loop->upper - begin) / loop->num_threads);
+        int64_t end = std::min(begin + chunk, loop->upper);
+        if (loop->next.compare_exchange_weak(begin, end, std::memory_order_relaxed)) {
+            loop->fn(loop->data, begin, end);
+            begin = loop->next.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void ThreadPool::parallel_for(int32_t num_threads, int64_t lower, int64_t upper, int64_t grain, Schedule schedule, TaskFn fn, void* data) {
+    if (schedule == Schedule::Static && grain <= 0) {
+        parallel_for(num_threads, lower, upper, fn, data);
+        return;
+    }
+    if (upper <= lower)
+        return;
+
+    // Without a grain size, use a few chunks per thread so that dynamic scheduling can balance the load
+    if (grain <= 0)
+        grain = schedule == Schedule::Guided ? 1 : std::max<int64_t>(1, (upper - lower) / (int64_t(num_threads) * 8));
+
+    bool nested = in_task();
+    int64_t num_chunks = (upper - lower + grain - 1) / grain;
+    num_threads = int32_t(std::min<int64_t>(num_threads, num_chunks));
+    if (nested)
+        num_threads = int32_t(std::min<size_t>(num_threads, num_workers()));
+    if (num_threads <= 1) {
+        fn(data, lower, upper);
+        return;
+    }
+
+    if (!nested)
+        reserve(num_threads);
+
+    ScheduledLoop loop;
+    loop.fn = fn;
+    loop.data = data;
+    loop.lower = lower;
+    loop.upper = upper;
+    loop.grain = grain;
+    loop.num_threads = num_threads;
+    loop.next = lower;
+
+    TaskFn run = schedule == Schedule::Static  ? run_static_chunks  :
+                 schedule == Schedule::Dynamic ? run_dynamic_chunks :
+                                                 run_guided_chunks;
+    TaskGroup group;
+    for (int32_t i = 0; i < num_threads; ++i)
+        submit(group, run, &loop, i, 0);
+    wait(group);
+}
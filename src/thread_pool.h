@@ -0,0 +1,169 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/// Loop scheduling policies for `ThreadPool::parallel_for()`.
+enum class Schedule : int32_t {
+    Static = 0,  ///< Chunks of `grain` iterations are assigned round-robin, or equal pieces if `grain` is zero.
+    Dynamic = 1, ///< Threads grab the next chunk of `grain` iterations from a shared counter.
+    Guided = 2   ///< Like Dynamic, but chunks shrink from `remaining / num_threads` down to `grain` iterations.
+};
+
+/// Tracks the completion of a set of tasks submitted to the thread pool.
+class TaskGroup {
+public:
+    TaskGroup() : pending_(0) {}
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator = (const TaskGroup&) = delete;
+
+    /// Returns true when all the tasks of this group have finished.
+    bool finished() const { return pending_.load() == 0; }
+
+private:
+    std::atomic<int64_t> pending_;
+
+    friend class ThreadPool;
+};
+
+/// Persistent pool of worker threads. Every worker owns a task deque: it pops tasks
+/// from the back of its own deque and steals from the front of the other deques when idle.
+/// Threads waiting for a task group execute pending tasks instead of blocking,
+/// which makes nested parallelism safe.
+/// With TBB, the pool only runs futures, spawned tasks, streams and large copies, while parallel
+/// loops run on the TBB workers. The pool is then limited to a fraction of the hardware threads
+/// (see `set_worker_limit()`), so that both sets of threads together do not oversubscribe the cores.
+class ThreadPool {
+public:
+    /// Task entry point: `fn(data, begin, end)`.
+    typedef void (*TaskFn)(void*, int64_t, int64_t);
+
+    struct Task {
+        TaskFn fn;
+        void* data;
+        int64_t begin;
+        int64_t end;
+        TaskGroup* group;
+        bool detached = false;
+    };
+
+    static constexpr size_t max_workers = 256;
+
+    /// Returns the pool of the process, starting it on first use.
+    static ThreadPool& instance();
+    /// Limits the number of workers (0 = no limit), must be called before the pool is first used.
+    /// Only the workers that replace blocked ones (see `block_begin()`) or that run detached tasks
+    /// (see `submit_detached()`) may exceed the limit.
+    static void set_worker_limit(size_t limit);
+
+    ~ThreadPool();
+
+    /// Resolves the number of threads for a parallel construct (0 = hardware concurrency).
+    static int32_t resolve_threads(int32_t num_threads);
+    /// Returns the index of the calling worker, or -1 when called from outside the pool.
+    static int32_t current_worker();
+    /// Returns true if the calling thread is executing a task of the pool.
+    static bool in_task();
+
+    /// Number of worker threads currently running.
+    size_t num_workers() const { return num_workers_.load(std::memory_order_acquire); }
+    /// Makes sure that at least the given number of workers (up to the limit) are running.
+    void reserve(size_t count);
+
+    /// Enables or disables NUMA mode: workers are pinned to cores, grouped by NUMA node,
+    /// and static loops always give the same sub-range to the same worker, so that
+    /// memory first touched in a loop stays local to the node that later accesses it.
+    void set_numa(bool enable);
+    bool numa() const { return numa_.load(std::memory_order_relaxed); }
+
+    /// Enqueues a task. The task is placed on the deque of the given worker,
+    /// or on the deque of the calling worker if negative.
+    /// Pinned tasks are only executed by the worker they are placed on, unless that worker is blocked or runs
+    /// a detached task (which may take arbitrarily long): other threads then steal its pinned tasks.
+    void submit(TaskGroup& group, TaskFn fn, void* data, int64_t begin, int64_t end, int32_t worker = -1, bool pinned = false);
+    /// Enqueues a task that may wait on other tasks (e.g. a future). Such tasks only start on idle workers,
+    /// never on a thread that waits for something else, since they could wait on that thread in turn.
+    /// Like threads, detached tasks may also wait on each other: the pool grows so that there are at least
+    /// as many workers as running and queued detached tasks (up to `max_workers`).
+    void submit_detached(TaskGroup& group, TaskFn fn, void* data, int64_t begin = 0, int64_t end = 0);
+    /// Waits for the completion of all the tasks of the group, executing pending tasks meanwhile
+    /// (but no detached tasks).
+    void wait(TaskGroup& group);
+    /// Waits for the completion of all the tasks of the group without executing other tasks, for waits
+    /// on detached tasks: a task picked up while waiting could itself wait on the caller.
+    /// A calling worker counts as blocked (see `block_begin()`).
+    void wait_blocked(TaskGroup& group);
+    /// Marks the group as pending until a matching call to `release()`, independently of its tasks.
+    void retain(TaskGroup& group);
+    /// Ends a `retain()` on the group, waking up the threads waiting for it if it is finished.
+    void release(TaskGroup& group);
+
+    /// Must surround any blocking wait of a task outside of the pool (e.g. on a barrier).
+    /// While workers are blocked, the pool starts additional workers so that the tasks
+    /// they are waiting for can still run.
+    void block_begin();
+    void block_end();
+
+    /// Splits the range [lower, upper) in `num_chunks` pieces of equal size, runs them in the pool and waits for them.
+    void parallel_for(int32_t num_chunks, int64_t lower, int64_t upper, TaskFn fn, void* data);
+    /// Runs the range [lower, upper) on `num_threads` threads of the pool with the given scheduling policy and waits for it.
+    void parallel_for(int32_t num_threads, int64_t lower, int64_t upper, int64_t grain, Schedule schedule, TaskFn fn, void* data);
+    /// Like `parallel_for()`, but the chunks run on the CPUs of a NUMA node (index in `numa_nodes()`).
+    /// Uses as many chunks as the node has CPUs if `num_chunks` is not positive.
+    void parallel_for_node(size_t node, int32_t num_chunks, int64_t lower, int64_t upper, TaskFn fn, void* data);
+
+private:
+    struct alignas(64) Worker {
+        std::mutex lock;
+        std::deque<Task> tasks;
+        std::deque<Task> pinned;
+        std::atomic<int32_t> num_pinned { 0 };
+        std::atomic<int32_t> unavailable { 0 }; ///< Non-zero while the worker is blocked or runs a detached task
+        std::thread thread;
+    };
+
+    ThreadPool();
+
+    void worker_main(int32_t index);
+    bool pop_pinned_task(int32_t index, Task& task);
+    bool pop_task(int32_t index, Task& task);
+    bool steal_task(int32_t index, Task& task);
+    bool steal_pinned_task(int32_t index, Task& task);
+    bool has_stealable_pinned() const;
+    void set_available(int32_t index, bool available);
+    bool pop_detached_task(Task& task);
+    bool find_task(int32_t index, Task& task, bool detached);
+    void run_task(const Task& task);
+    void push_task(int32_t index, const Task& task, bool pinned);
+    bool has_work(int32_t index, bool detached) const;
+    void grow(size_t count);
+    void pin_worker(size_t index);
+
+    std::unique_ptr<Worker> workers_[max_workers];
+    std::mutex detached_lock_;
+    std::deque<Task> detached_;
+    std::atomic<int64_t> num_detached_;
+    std::atomic<int64_t> running_detached_;
+    std::atomic<size_t> num_workers_;
+    size_t limit_;
+    std::atomic<size_t> next_worker_;
+    std::atomic<int64_t> queued_;
+    std::atomic<int32_t> sleepers_;
+    std::atomic<size_t> blocked_;
+    std::atomic<bool> stop_;
+    std::atomic<bool> numa_;
+    std::mutex grow_mutex_;
+    std::mutex sleep_mutex_;
+    std::condition_variable sleep_cond_;
+    std::atomic<int32_t> blocked_waiters_;
+    std::condition_variable blocked_cond_;  ///< Threads in `wait_blocked()`, which must not be woken up for new tasks
+};
+
+#endif
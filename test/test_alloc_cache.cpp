@@ -0,0 +1,91 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "anydsl_runtime.h"
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (false)
+
+static AllocCacheStats stats() {
+    AllocCacheStats stats;
+    anydsl_alloc_cache_stats(&stats);
+    return stats;
+}
+
+// Without ANYDSL_ALLOC_CACHE, the caches only keep a few MiB per CPU
+static void test_default_limit() {
+    if (std::getenv("ANYDSL_ALLOC_CACHE"))
+        return;
+    auto limit = stats().limit;
+    CHECK(limit > 0);
+    CHECK(limit <= 16 * int64_t(1 << 20) * std::max(1, int(std::thread::hardware_concurrency())));
+}
+
+// A released block is handed out again to the next allocation of the same size class
+static void test_reuse() {
+    anydsl_trim();
+    void* first = anydsl_alloc(ANYDSL_HOST, 1000);
+    std::memset(first, 1, 1000);
+    anydsl_release(ANYDSL_HOST, first);
+    CHECK(stats().retained > 0);
+
+    auto before = stats();
+    void* second = anydsl_alloc(ANYDSL_HOST, 990);
+    auto after = stats();
+    CHECK(second == first);
+    CHECK(after.hits == before.hits + 1);
+    CHECK(after.misses == before.misses);
+    anydsl_release(ANYDSL_HOST, second);
+
+    anydsl_trim();
+    CHECK(stats().retained == 0);
+}
+
+// Blocks released above the limit are freed, and a limit of zero disables caching
+static void test_limit() {
+    auto initial = stats().limit;
+    const int64_t block_size = 256 << 10;
+
+    anydsl_set_alloc_cache_limit(1 << 20);
+    CHECK(stats().limit == 1 << 20);
+    std::vector<void*> blocks;
+    for (int i = 0; i < 16; ++i)
+        blocks.push_back(anydsl_alloc(ANYDSL_HOST, block_size));
+    for (auto block : blocks)
+        anydsl_release(ANYDSL_HOST, block);
+    CHECK(stats().retained > 0);
+    CHECK(stats().retained <= 1 << 20);
+
+    // Lowering the limit shrinks the caches, the magazine of this thread is emptied on its next allocation
+    anydsl_set_alloc_cache_limit(0);
+    auto before = stats();
+    void* ptr = anydsl_alloc(ANYDSL_HOST, block_size);
+    anydsl_release(ANYDSL_HOST, ptr);
+    ptr = anydsl_alloc(ANYDSL_HOST, block_size);
+    anydsl_release(ANYDSL_HOST, ptr);
+    auto after = stats();
+    CHECK(after.retained == 0);
+    CHECK(after.hits == before.hits);
+
+    anydsl_set_alloc_cache_limit(initial);
+}
+
+int main() {
+    test_default_limit();
+    test_reuse();
+    test_limit();
+    if (failures == 0)
+        std::printf("all checks passed\n");
+    return failures == 0 ? 0 : 1;
+}
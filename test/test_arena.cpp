@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "anydsl_runtime.h"
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (false)
+
+static const int64_t capacity = 1 << 16;
+
+// Allocations are aligned relative to the start of the arena and never overlap
+static void test_alloc(int32_t arena) {
+    auto base = static_cast<char*>(anydsl_arena_alloc(arena, 1, 1));
+    CHECK(base != nullptr);
+    std::vector<std::pair<char*, int64_t>> blocks = { { base, 1 } };
+    for (int64_t align : { 0, 1, 8, 256, 4096 }) {
+        for (int64_t size : { 1, 3, 100, 1000 }) {
+            auto ptr = static_cast<char*>(anydsl_arena_alloc(arena, size, align));
+            CHECK(ptr != nullptr);
+            CHECK((ptr - base) % (align > 0 ? align : 64) == 0);
+            std::memset(ptr, 0xab, size);
+            blocks.emplace_back(ptr, size);
+        }
+    }
+    std::sort(blocks.begin(), blocks.end());
+    bool disjoint = true;
+    for (size_t i = 1; i < blocks.size(); ++i)
+        disjoint &= blocks[i - 1].first + blocks[i - 1].second <= blocks[i].first;
+    CHECK(disjoint);
+    CHECK(blocks.back().first + blocks.back().second <= base + capacity);
+
+    CHECK(anydsl_arena_alloc(arena, 0, 0) == nullptr);
+    CHECK(anydsl_arena_alloc(arena, capacity, 0) == nullptr);
+
+    // Resetting the arena hands out the same memory again
+    anydsl_arena_reset(arena);
+    CHECK(anydsl_arena_alloc(arena, 1, 1) == base);
+    anydsl_arena_reset(arena);
+    CHECK(anydsl_arena_alloc(arena, capacity, 1) == base);
+    CHECK(anydsl_arena_alloc(arena, 1, 1) == nullptr);
+    anydsl_arena_reset(arena);
+}
+
+struct ConcurrentRun {
+    int32_t arena;
+    std::atomic<int64_t> allocated;
+    std::vector<char*> ptrs;
+};
+
+static void alloc_body(void* data, int32_t begin, int32_t end) {
+    auto run = static_cast<ConcurrentRun*>(data);
+    for (int32_t i = begin; i < end; ++i) {
+        auto ptr = static_cast<char*>(anydsl_arena_alloc(run->arena, 100, 64));
+        run->ptrs[i] = ptr;
+        if (ptr) {
+            std::memset(ptr, i & 0xff, 100);
+            run->allocated += 100;
+        }
+    }
+}
+
+// Threads allocating at the same time get disjoint blocks, until the arena is full
+static void test_concurrent(int32_t arena) {
+    const int32_t n = 1000;
+    ConcurrentRun run { arena, { 0 }, std::vector<char*>(n) };
+    anydsl_parallel_for(4, 0, n, &run, (void*)alloc_body);
+    std::vector<char*> ptrs;
+    for (int32_t i = 0; i < n; ++i) {
+        if (run.ptrs[i]) {
+            CHECK(run.ptrs[i][0] == char(i & 0xff) && run.ptrs[i][99] == char(i & 0xff));
+            ptrs.push_back(run.ptrs[i]);
+        }
+    }
+    // 128 bytes per block once aligned
+    CHECK(int64_t(ptrs.size()) == capacity / 128);
+    std::sort(ptrs.begin(), ptrs.end());
+    bool disjoint = true;
+    for (size_t i = 1; i < ptrs.size(); ++i)
+        disjoint &= ptrs[i - 1] + 100 <= ptrs[i];
+    CHECK(disjoint);
+    anydsl_arena_reset(arena);
+}
+
+int main() {
+    int32_t arena = anydsl_arena_create(ANYDSL_HOST, capacity);
+    test_alloc(arena);
+    test_concurrent(arena);
+    anydsl_arena_destroy(arena);
+
+    // Destroyed arenas give their handles back: this runs past the maximum number of arenas
+    for (int i = 0; i < 70000; ++i) {
+        int32_t other = anydsl_arena_create(ANYDSL_HOST, 4096);
+        CHECK(anydsl_arena_alloc(other, 4096, 0) != nullptr);
+        anydsl_arena_destroy(other);
+    }
+
+    if (failures == 0)
+        std::printf("all checks passed\n");
+    return failures == 0 ? 0 : 1;
+}
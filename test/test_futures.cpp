@@ -0,0 +1,169 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+#include "anydsl_runtime.h"
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (false)
+
+// Tasks that start by waiting on another future, instead of being continuations of it
+struct Link {
+    int32_t dependency;
+    int32_t index;
+};
+
+static std::atomic<int32_t> completed(0);
+static std::atomic<int32_t> order_errors(0);
+
+static int32_t sleep_task(void*) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    completed++;
+    return 0;
+}
+
+static int32_t wait_task(void* data) {
+    auto link = static_cast<Link*>(data);
+    anydsl_wait(link->dependency);
+    if (completed.fetch_add(1) != link->index)
+        order_errors++;
+    return 0;
+}
+
+// A waits on nothing, B waits on A, C waits on B: a thread that runs B must not run C while waiting on A
+static void test_wait_chain(int32_t length) {
+    completed = 0;
+    order_errors = 0;
+    Link links[64];
+    int32_t id = anydsl_async(nullptr, (void*)sleep_task);
+    // Let A start first, so that B is queued before C
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    for (int32_t i = 0; i < length; ++i) {
+        links[i] = Link { id, i + 1 };
+        id = anydsl_async(&links[i], (void*)wait_task);
+    }
+    anydsl_wait(id);
+    CHECK(completed == length + 1);
+    CHECK(order_errors == 0);
+}
+
+static void empty_body(void*, int32_t, int32_t) {}
+
+static int32_t loop_task(void*) {
+    // The loop waits for its chunks: this must not start the continuation that waits on this task
+    for (int32_t i = 0; i < 100; ++i)
+        anydsl_parallel_for(4, 0, 64, nullptr, (void*)empty_body);
+    completed++;
+    return 0;
+}
+
+static void test_loop_then_wait() {
+    completed = 0;
+    order_errors = 0;
+    int32_t loop = anydsl_async(nullptr, (void*)loop_task);
+    Link link = { loop, 1 };
+    int32_t next = anydsl_async(&link, (void*)wait_task);
+    anydsl_wait(next);
+    CHECK(completed == 2);
+    CHECK(order_errors == 0);
+}
+
+static int32_t count_task(void*) {
+    completed++;
+    return 0;
+}
+
+static void test_then_chain() {
+    completed = 0;
+    int32_t id = anydsl_async(nullptr, (void*)sleep_task);
+    for (int32_t i = 0; i < 100; ++i)
+        id = anydsl_then(id, nullptr, (void*)count_task);
+    anydsl_wait(id);
+    CHECK(completed == 101);
+}
+
+static int32_t ordered_task(void* data) {
+    if (completed.fetch_add(1) != *static_cast<int32_t*>(data))
+        order_errors++;
+    return 0;
+}
+
+// Continuations as lowered by the artic frontend: anydsl_then_next, then a spawn
+static void test_then_next_chain() {
+    completed = 0;
+    order_errors = 0;
+    int32_t indices[100];
+    int32_t id = anydsl_async(nullptr, (void*)sleep_task);
+    for (int32_t i = 0; i < 100; ++i) {
+        indices[i] = i + 1;
+        anydsl_then_next(id);
+        id = anydsl_spawn_thread(&indices[i], (void*)ordered_task);
+    }
+    anydsl_wait(id);
+    CHECK(completed == 101);
+    CHECK(order_errors == 0);
+}
+
+static int32_t channel;
+
+static int32_t pop_task(void*) {
+    int32_t value;
+    anydsl_channel_pop(channel, &value);
+    completed++;
+    return 0;
+}
+
+// The main thread waits on A while a spawned consumer waits on the main thread:
+// waiting on A must not run the consumer on the main thread
+static void test_outside_waiter() {
+    completed = 0;
+    channel = anydsl_channel_create(sizeof(int32_t), 4);
+    int32_t sleeper = anydsl_async(nullptr, (void*)sleep_task);
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    int32_t consumer = anydsl_spawn_thread(nullptr, (void*)pop_task);
+    anydsl_wait(sleeper);
+    int32_t value = 1;
+    anydsl_channel_push(channel, &value);
+    anydsl_sync_thread(consumer);
+    anydsl_channel_destroy(channel);
+    CHECK(completed == 2);
+}
+
+static int32_t rendezvous_task(void*) {
+    completed++;
+    while (completed < 3)
+        std::this_thread::yield();
+    return 0;
+}
+
+// Spawned tasks behave like threads: each of them must start even if the others never finish
+static void test_spawn_rendezvous() {
+    completed = 0;
+    int32_t ids[3];
+    for (auto& id : ids)
+        id = anydsl_spawn_thread(nullptr, (void*)rendezvous_task);
+    for (auto id : ids)
+        anydsl_sync_thread(id);
+    CHECK(completed == 3);
+}
+
+int main() {
+    test_wait_chain(2);
+    test_wait_chain(64);
+    test_loop_then_wait();
+    test_then_chain();
+    test_then_next_chain();
+    test_outside_waiter();
+    test_spawn_rendezvous();
+    if (failures == 0)
+        std::printf("all checks passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,112 @@
+#include <atomic>
+#include <cstdio>
+
+#include "anydsl_runtime.h"
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (false)
+
+// Every task records how often it ran, and at which position in the execution
+static const int num_slots = 16;
+static std::atomic<int32_t> runs[num_slots];
+static std::atomic<int32_t> position[num_slots];
+static std::atomic<int32_t> clock_(0);
+
+static void reset() {
+    for (int i = 0; i < num_slots; ++i) {
+        runs[i] = 0;
+        position[i] = -1;
+    }
+    clock_ = 0;
+}
+
+static void record(uint64_t slot) {
+    position[slot] = clock_.fetch_add(1);
+    runs[slot]++;
+}
+
+static Closure task_closure(int slot) {
+    return Closure { record, uint64_t(slot) };
+}
+
+// Two entry tasks that both feed the same sink: both entries must run
+static void test_multiple_entries() {
+    reset();
+    int32_t graph = anydsl_create_graph();
+    int32_t a = anydsl_create_task(graph, task_closure(0));
+    int32_t b = anydsl_create_task(graph, task_closure(1));
+    int32_t c = anydsl_create_task(graph, task_closure(2));
+    anydsl_create_edge(a, c);
+    anydsl_create_edge(b, c);
+    anydsl_execute_graph(graph, -1);
+    for (int i = 0; i < 3; ++i)
+        CHECK(runs[i] == 1);
+    CHECK(position[2] > position[0]);
+    CHECK(position[2] > position[1]);
+    anydsl_destroy_graph(graph);
+}
+
+// A chain with an explicit root, executed several times
+static void test_root_chain() {
+    reset();
+    int32_t graph = anydsl_create_graph();
+    int32_t tasks[4];
+    for (int i = 0; i < 4; ++i)
+        tasks[i] = anydsl_create_task(graph, task_closure(i));
+    for (int i = 0; i < 3; ++i)
+        anydsl_create_edge(tasks[i], tasks[i + 1]);
+    for (int n = 1; n <= 3; ++n) {
+        anydsl_execute_graph(graph, tasks[0]);
+        for (int i = 0; i < 4; ++i)
+            CHECK(runs[i] == n);
+        for (int i = 0; i < 3; ++i)
+            CHECK(position[i] < position[i + 1]);
+    }
+    anydsl_destroy_graph(graph);
+}
+
+// Destroyed graphs hand their ids back, and the new graph only runs its own tasks
+static void test_destroy_reuse() {
+    reset();
+    int32_t graph = anydsl_create_graph();
+    int32_t first = anydsl_create_task(graph, task_closure(0));
+    int32_t last  = anydsl_create_task(graph, task_closure(1));
+    anydsl_destroy_graph(graph);
+
+    int32_t reused = anydsl_create_graph();
+    CHECK(reused == graph);
+    int32_t task = anydsl_create_task(reused, task_closure(2));
+    CHECK(task == first || task == last);
+    anydsl_execute_graph(reused, task);
+    CHECK(runs[0] == 0);
+    CHECK(runs[1] == 0);
+    CHECK(runs[2] == 1);
+    anydsl_destroy_graph(reused);
+
+    // Creating and destroying many graphs does not grow the tables
+    for (int i = 0; i < 1000; ++i) {
+        int32_t g = anydsl_create_graph();
+        CHECK(g == graph);
+        int32_t t = anydsl_create_task(g, task_closure(3));
+        CHECK(t == task);
+        anydsl_execute_graph(g, -1);
+        anydsl_destroy_graph(g);
+    }
+    CHECK(runs[3] == 1000);
+}
+
+int main() {
+    test_multiple_entries();
+    test_root_chain();
+    test_destroy_reuse();
+    if (failures == 0)
+        std::printf("all checks passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,102 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include "anydsl_runtime.h"
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (false)
+
+static const int64_t file_size = 3 * 4096 + 123;
+
+static char expected(int64_t i) {
+    return char(i * 7 + 3);
+}
+
+static std::string create_file() {
+    std::string path = "test_map_file_" + std::to_string(getpid()) + ".bin";
+    std::vector<char> data(file_size);
+    for (int64_t i = 0; i < file_size; ++i)
+        data[i] = expected(i);
+    std::ofstream(path, std::ios::binary).write(data.data(), file_size);
+    return path;
+}
+
+static int count_fds() {
+    int count = 0;
+    if (DIR* dir = opendir("/proc/self/fd")) {
+        while (readdir(dir))
+            count++;
+        closedir(dir);
+    }
+    return count;
+}
+
+static bool matches(const char* ptr, int64_t offset, int64_t size) {
+    for (int64_t i = 0; i < size; ++i) {
+        if (ptr[i] != expected(offset + i))
+            return false;
+    }
+    return true;
+}
+
+// Ranges that start inside a page, and ranges that extend to the end of the file
+static void test_ranges(const std::string& path) {
+    CHECK(anydsl_file_size(path.c_str()) == file_size);
+    int64_t offsets[] = { 0, 1, 4095, 4096, 5000, file_size - 1 };
+    for (auto offset : offsets) {
+        auto ptr = static_cast<const char*>(anydsl_map_file(ANYDSL_HOST, path.c_str(), offset, 0, ANYDSL_MAP_READ_ONLY));
+        CHECK(matches(ptr, offset, file_size - offset));
+        anydsl_unmap(ANYDSL_HOST, (void*)ptr);
+
+        int64_t size = (file_size - offset + 1) / 2;
+        ptr = static_cast<const char*>(anydsl_map_file(ANYDSL_HOST, path.c_str(), offset, size, ANYDSL_MAP_POPULATE | ANYDSL_MAP_SEQUENTIAL));
+        CHECK(matches(ptr, offset, size));
+        anydsl_unmap(ANYDSL_HOST, (void*)ptr);
+    }
+}
+
+// Writes to a private mapping are visible through the mapping, but never reach the file
+static void test_private(const std::string& path) {
+    auto ptr = static_cast<char*>(anydsl_map_file(ANYDSL_HOST, path.c_str(), 100, 1000, ANYDSL_MAP_PRIVATE));
+    std::memset(ptr, 0, 1000);
+    CHECK(ptr[0] == 0 && ptr[999] == 0);
+    anydsl_unmap(ANYDSL_HOST, ptr);
+
+    auto again = static_cast<const char*>(anydsl_map_file(ANYDSL_HOST, path.c_str(), 0, 0, ANYDSL_MAP_READ_ONLY));
+    CHECK(matches(again, 0, file_size));
+    anydsl_unmap(ANYDSL_HOST, (void*)again);
+}
+
+// Mapping a file does not keep its descriptor open
+static void test_descriptors(const std::string& path) {
+    int fds = count_fds();
+    for (int i = 0; i < 100; ++i) {
+        void* ptr = anydsl_map_file(ANYDSL_HOST, path.c_str(), i, 0, ANYDSL_MAP_READ_ONLY);
+        anydsl_unmap(ANYDSL_HOST, ptr);
+    }
+    CHECK(count_fds() == fds);
+}
+
+int main() {
+    std::string path = create_file();
+    test_ranges(path);
+    test_private(path);
+    test_descriptors(path);
+    std::remove(path.c_str());
+    if (failures == 0)
+        std::printf("all checks passed\n");
+    return failures == 0 ? 0 : 1;
+}
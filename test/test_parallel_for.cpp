@@ -0,0 +1,81 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "anydsl_runtime.h"
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (false)
+
+static std::vector<std::atomic<int32_t>> visits(1000);
+
+static void visit_body(void*, int32_t lower, int32_t upper) {
+    for (int32_t i = lower; i < upper; ++i)
+        visits[i]++;
+}
+
+static bool visited_once(int32_t lower, int32_t upper) {
+    bool once = true;
+    for (int32_t i = 0; i < int32_t(visits.size()); ++i) {
+        once &= visits[i].load() == (i >= lower && i < upper ? 1 : 0);
+        visits[i] = 0;
+    }
+    return once;
+}
+
+// Every iteration runs exactly once, whatever the number of threads and the schedule
+static void test_coverage() {
+    for (int32_t num_threads : { 0, 1, 3, 16 }) {
+        anydsl_parallel_for(num_threads, 10, 990, nullptr, (void*)visit_body);
+        CHECK(visited_once(10, 990));
+        for (int32_t schedule : { ANYDSL_SCHEDULE_STATIC, ANYDSL_SCHEDULE_DYNAMIC, ANYDSL_SCHEDULE_GUIDED }) {
+            for (int32_t grain : { 0, 1, 7 }) {
+                anydsl_parallel_for_sched(num_threads, 3, 997, grain, schedule, nullptr, (void*)visit_body);
+                CHECK(visited_once(3, 997));
+            }
+        }
+    }
+}
+
+static int32_t channel;
+
+static int32_t pop_task(void*) {
+    int32_t value;
+    anydsl_channel_pop(channel, &value);
+    return 0;
+}
+
+static void empty_body(void*, int32_t, int32_t) {}
+
+// In NUMA mode, the chunks of a loop are placed on fixed workers: the chunks of a worker
+// that is blocked in a spawned task must still run
+static void test_numa_blocked_worker() {
+    anydsl_set_numa(true);
+    channel = anydsl_channel_create(sizeof(int32_t), 4);
+    int32_t consumer = anydsl_spawn_thread(nullptr, (void*)pop_task);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    for (int32_t i = 0; i < 100; ++i)
+        anydsl_parallel_for(4, 0, 64, nullptr, (void*)empty_body);
+    int32_t value = 1;
+    anydsl_channel_push(channel, &value);
+    anydsl_sync_thread(consumer);
+    anydsl_channel_destroy(channel);
+    anydsl_set_numa(false);
+}
+
+int main() {
+    test_coverage();
+    test_numa_blocked_worker();
+    if (failures == 0)
+        std::printf("all checks passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,86 @@
+#include <cstdio>
+#include <vector>
+
+#include "anydsl_runtime.h"
+#include "philox.h"
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (false)
+
+// Known answers of Philox4x32-10 from the Random123 distribution
+static void test_known_answers() {
+    uint32_t zero[4] = { 0, 0, 0, 0 };
+    philox::generate(zero, 0, 0);
+    CHECK(zero[0] == 0x6627e8d5 && zero[1] == 0xe169c58d && zero[2] == 0xbc57ac4c && zero[3] == 0x9b00dbd8);
+
+    uint32_t ones[4] = { 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff };
+    philox::generate(ones, 0xffffffff, 0xffffffff);
+    CHECK(ones[0] == 0x408f276d && ones[1] == 0x41c83b0e && ones[2] == 0xa20bc7c6 && ones[3] == 0x6d5451fd);
+
+    uint32_t pi[4] = { 0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344 };
+    philox::generate(pi, 0xa4093822, 0x299f31d0);
+    CHECK(pi[0] == 0xd16cfe09 && pi[1] == 0x94fdcceb && pi[2] == 0x5001e420 && pi[3] == 0x24126ea1);
+}
+
+// Element i is number (i % 4) of the block with counter (i / 4, stream)
+static float reference(int64_t i, uint64_t seed, uint64_t stream) {
+    uint64_t block = uint64_t(i) / 4;
+    uint32_t ctr[4] = { uint32_t(block), uint32_t(block >> 32), uint32_t(stream), uint32_t(stream >> 32) };
+    philox::generate(ctr, uint32_t(seed), uint32_t(seed >> 32));
+    return philox::to_float(ctr[i % 4]);
+}
+
+// The vectorized and parallel fill produces the numbers of the reference, for any length
+static void test_fill() {
+    const uint64_t seed = 0x0123456789abcdefull, stream = 0xfedcba9876543210ull;
+    for (int64_t n : { 1, 3, 4, 17, 4096, 4099, 100003 }) {
+        std::vector<float> buf(n + 1, -1.0f);
+        anydsl_random_fill_f32(buf.data(), n, seed, stream);
+        bool equal = true, in_range = true;
+        for (int64_t i = 0; i < n; ++i) {
+            equal &= buf[i] == reference(i, seed, stream);
+            in_range &= buf[i] >= 0.0f && buf[i] < 1.0f;
+        }
+        CHECK(equal);
+        CHECK(in_range);
+        CHECK(buf[n] == -1.0f);
+    }
+}
+
+// Fills are deterministic, and distinct seeds or streams give distinct sequences
+static void test_determinism() {
+    const int64_t n = 10000;
+    std::vector<float> a(n), b(n), c(n), d(n);
+    anydsl_random_fill_f32(a.data(), n, 42, 0);
+    anydsl_random_fill_f32(b.data(), n, 42, 0);
+    anydsl_random_fill_f32(c.data(), n, 42, 1);
+    anydsl_random_fill_f32(d.data(), n, 43, 0);
+    int same_b = 0, same_c = 0, same_d = 0;
+    double sum = 0;
+    for (int64_t i = 0; i < n; ++i) {
+        same_b += a[i] == b[i];
+        same_c += a[i] == c[i];
+        same_d += a[i] == d[i];
+        sum += a[i];
+    }
+    CHECK(same_b == n);
+    CHECK(same_c < 10);
+    CHECK(same_d < 10);
+    CHECK(sum / n > 0.48 && sum / n < 0.52);
+}
+
+int main() {
+    test_known_answers();
+    test_fill();
+    test_determinism();
+    if (failures == 0)
+        std::printf("all checks passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,92 @@
+#include <cstdio>
+#include <vector>
+
+#include "anydsl_runtime.h"
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (false)
+
+// Sizes below and above the serial threshold, with partial vectors and uneven blocks
+static const int64_t sizes[] = { 0, 1, 7, 1000, (1 << 14) + 3, (1 << 17) + 5, 1 << 20 };
+static const int32_t thread_counts[] = { 0, 1, 3, 8 };
+
+static uint32_t hash(uint64_t i) {
+    uint64_t x = i * 0x9E3779B97F4A7C15ull;
+    return uint32_t((x ^ (x >> 29)) >> 16);
+}
+
+template <typename T, typename Scan>
+static void check_scan(Scan scan) {
+    for (auto n : sizes) {
+        // Small values keep float sums exact
+        std::vector<T> in(n), out(n + 1), expected(n);
+        for (int64_t i = 0; i < n; ++i)
+            in[i] = T(int32_t(hash(i) % 7) - 3);
+        for (bool exclusive : { false, true }) {
+            T sum = 0;
+            for (int64_t i = 0; i < n; ++i) {
+                expected[i] = exclusive ? sum : sum + in[i];
+                sum += in[i];
+            }
+            for (auto num_threads : thread_counts) {
+                out[n] = T(42);
+                scan(num_threads, in.data(), out.data(), n, exclusive);
+                bool equal = true;
+                for (int64_t i = 0; i < n; ++i)
+                    equal &= out[i] == expected[i];
+                CHECK(equal);
+                CHECK(out[n] == T(42));
+            }
+        }
+    }
+}
+
+// Scanning in place is allowed
+static void test_in_place() {
+    std::vector<int32_t> data(1 << 18, 1);
+    anydsl_scan_i32(4, data.data(), data.data(), int64_t(data.size()), false);
+    bool equal = true;
+    for (size_t i = 0; i < data.size(); ++i)
+        equal &= data[i] == int32_t(i + 1);
+    CHECK(equal);
+}
+
+static void test_compact() {
+    for (auto n : sizes) {
+        for (int32_t every : { 1, 3, 1000000 }) {
+            std::vector<int32_t> flags(n), indices(n + 1, -1), expected;
+            for (int64_t i = 0; i < n; ++i) {
+                flags[i] = hash(i) % every == 0 ? int32_t(hash(i) % 5 + 1) : 0;
+                if (flags[i])
+                    expected.push_back(int32_t(i));
+            }
+            for (auto num_threads : thread_counts) {
+                int32_t count = anydsl_compact(num_threads, flags.data(), indices.data(), int32_t(n));
+                CHECK(count == int32_t(expected.size()));
+                bool equal = count == int32_t(expected.size());
+                for (int32_t i = 0; equal && i < count; ++i)
+                    equal &= indices[i] == expected[i];
+                CHECK(equal);
+                CHECK(indices[count] == -1);
+            }
+        }
+    }
+}
+
+int main() {
+    check_scan<int32_t>(anydsl_scan_i32);
+    check_scan<int64_t>(anydsl_scan_i64);
+    check_scan<float>(anydsl_scan_f32);
+    test_in_place();
+    test_compact();
+    if (failures == 0)
+        std::printf("all checks passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,120 @@
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "anydsl_runtime.h"
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (false)
+
+static const int64_t size = 1 << 20;
+
+static std::vector<char> pattern(int seed) {
+    std::vector<char> data(size);
+    for (int64_t i = 0; i < size; ++i)
+        data[i] = char(i * 31 + seed);
+    return data;
+}
+
+// Copies of a stream run in order: every copy reads what the previous one wrote
+static void test_order() {
+    auto src = pattern(1);
+    std::vector<std::vector<char>> bufs(8, std::vector<char>(size, 0));
+    int32_t stream = anydsl_stream_create(ANYDSL_HOST);
+    anydsl_copy_async(ANYDSL_HOST, src.data(), 0, ANYDSL_HOST, bufs[0].data(), 0, size, stream);
+    for (size_t i = 1; i < bufs.size(); ++i)
+        anydsl_copy_async(ANYDSL_HOST, bufs[i - 1].data(), 0, ANYDSL_HOST, bufs[i].data(), 0, size, stream);
+    anydsl_stream_synchronize(stream);
+    CHECK(bufs.back() == src);
+
+    // Offsets apply to both sides of the copy
+    std::vector<char> shifted(size, 0);
+    anydsl_copy_async(ANYDSL_HOST, src.data(), 100, ANYDSL_HOST, shifted.data(), 200, size - 300, stream);
+    anydsl_stream_synchronize(stream);
+    CHECK(std::memcmp(shifted.data() + 200, src.data() + 100, size - 300) == 0);
+    CHECK(shifted[199] == 0 && shifted[size - 100] == 0);
+    anydsl_stream_destroy(stream);
+}
+
+// An event completes once the operations recorded before it have completed
+static void test_events() {
+    int32_t stream = anydsl_stream_create(ANYDSL_HOST);
+    // Events of idle streams are already complete
+    anydsl_event_wait(anydsl_event_record(stream));
+
+    std::vector<std::vector<char>> srcs, dsts;
+    std::vector<int32_t> events;
+    for (int i = 0; i < 16; ++i) {
+        srcs.push_back(pattern(i));
+        dsts.emplace_back(size, 0);
+        anydsl_copy_async(ANYDSL_HOST, srcs[i].data(), 0, ANYDSL_HOST, dsts[i].data(), 0, size, stream);
+        events.push_back(anydsl_event_record(stream));
+    }
+    for (int i = 0; i < 16; ++i) {
+        anydsl_event_wait(events[i]);
+        CHECK(dsts[i] == srcs[i]);
+    }
+    anydsl_stream_destroy(stream);
+}
+
+// Destroying a stream waits for its pending copies. Copies to or from a NUMA node use a stream of the source.
+static void test_destroy_pending() {
+    auto src = pattern(7);
+    auto node = static_cast<char*>(anydsl_alloc(ANYDSL_HOST_NODE(0), size));
+    std::vector<char> dst(size, 0);
+    int32_t stream = anydsl_stream_create(ANYDSL_HOST);
+    anydsl_copy_async(ANYDSL_HOST, src.data(), 0, ANYDSL_HOST_NODE(0), node, 0, size, stream);
+    anydsl_stream_destroy(stream);
+    int32_t node_stream = anydsl_stream_create(ANYDSL_HOST_NODE(0));
+    anydsl_copy_async(ANYDSL_HOST_NODE(0), node, 0, ANYDSL_HOST, dst.data(), 0, size, node_stream);
+    anydsl_stream_destroy(node_stream);
+    CHECK(dst == src);
+    anydsl_release(ANYDSL_HOST_NODE(0), node);
+}
+
+struct StreamTask {
+    std::vector<char> src, dst;
+};
+
+// Tasks that wait for their streams while the other tasks hold the workers
+static int32_t stream_task(void* data) {
+    auto task = static_cast<StreamTask*>(data);
+    int32_t stream = anydsl_stream_create(ANYDSL_HOST);
+    anydsl_copy_async(ANYDSL_HOST, task->src.data(), 0, ANYDSL_HOST, task->dst.data(), 0, size, stream);
+    anydsl_event_wait(anydsl_event_record(stream));
+    anydsl_stream_destroy(stream);
+    return 0;
+}
+
+static void test_tasks() {
+    std::vector<StreamTask> tasks(12);
+    std::vector<int32_t> ids;
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        tasks[i].src = pattern(int(i));
+        tasks[i].dst.assign(size, 0);
+        ids.push_back(anydsl_async(&tasks[i], (void*)stream_task));
+    }
+    for (auto id : ids)
+        anydsl_wait(id);
+    bool equal = true;
+    for (auto& task : tasks)
+        equal &= task.dst == task.src;
+    CHECK(equal);
+}
+
+int main() {
+    test_order();
+    test_events();
+    test_destroy_pending();
+    test_tasks();
+    if (failures == 0)
+        std::printf("all checks passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,329 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "anydsl_runtime.h"
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (false)
+
+// Tasks that outnumber the workers of the pool: blocked tasks must let the others run
+static const int32_t num_tasks = 12;
+
+struct BarrierRun {
+    int32_t barrier;
+    int32_t num_phases;
+    std::atomic<int32_t> arrived[64];
+    std::atomic<int32_t> serial;
+    std::atomic<int32_t> errors;
+};
+
+// Every task must see all the tasks arrive at a phase once the barrier of that phase is passed
+static int32_t barrier_task(void* data) {
+    auto run = static_cast<BarrierRun*>(data);
+    for (int32_t phase = 0; phase < run->num_phases; ++phase) {
+        run->arrived[phase]++;
+        if (anydsl_barrier_wait(run->barrier))
+            run->serial++;
+        if (run->arrived[phase].load() != num_tasks)
+            run->errors++;
+    }
+    return 0;
+}
+
+static void test_barrier() {
+    BarrierRun run;
+    run.barrier = anydsl_barrier_create(num_tasks);
+    run.num_phases = 64;
+    for (auto& arrived : run.arrived)
+        arrived = 0;
+    run.serial = 0;
+    run.errors = 0;
+    std::vector<int32_t> tasks;
+    for (int32_t i = 0; i < num_tasks; ++i)
+        tasks.push_back(anydsl_async(&run, (void*)barrier_task));
+    for (auto task : tasks)
+        anydsl_wait(task);
+    CHECK(run.errors == 0);
+    // Exactly one task per phase is told that it arrived last
+    CHECK(run.serial == run.num_phases);
+    anydsl_barrier_destroy(run.barrier);
+}
+
+struct LatchRun {
+    int32_t latch;
+    int32_t gate;
+    std::atomic<int32_t> counted;
+    std::atomic<int32_t> released;
+};
+
+static int32_t latch_task(void* data) {
+    auto run = static_cast<LatchRun*>(data);
+    run->counted++;
+    anydsl_latch_count_down(run->latch, 1);
+    anydsl_latch_wait(run->gate);
+    run->released++;
+    return 0;
+}
+
+static void test_latch() {
+    LatchRun run;
+    run.latch = anydsl_latch_create(num_tasks + 2);
+    run.gate = anydsl_latch_create(1);
+    run.counted = 0;
+    run.released = 0;
+    CHECK(!anydsl_latch_try_wait(run.latch));
+    std::vector<int32_t> tasks;
+    for (int32_t i = 0; i < num_tasks; ++i)
+        tasks.push_back(anydsl_async(&run, (void*)latch_task));
+    // The tasks alone do not open the latch, counting down by more than one does
+    anydsl_latch_count_down(run.latch, 2);
+    anydsl_latch_wait(run.latch);
+    CHECK(anydsl_latch_try_wait(run.latch));
+    CHECK(run.counted == num_tasks);
+    CHECK(run.released == 0);
+    anydsl_latch_count_down(run.gate, 1);
+    for (auto task : tasks)
+        anydsl_wait(task);
+    CHECK(run.released == num_tasks);
+    anydsl_latch_destroy(run.latch);
+    anydsl_latch_destroy(run.gate);
+}
+
+struct SemaphoreRun {
+    int32_t semaphore;
+    int32_t limit;
+    std::atomic<int32_t> inside;
+    std::atomic<int32_t> max_inside;
+    std::atomic<int32_t> done;
+};
+
+static int32_t semaphore_task(void* data) {
+    auto run = static_cast<SemaphoreRun*>(data);
+    for (int i = 0; i < 100; ++i) {
+        anydsl_semaphore_acquire(run->semaphore);
+        int32_t inside = ++run->inside;
+        int32_t max_inside = run->max_inside.load();
+        while (inside > max_inside && !run->max_inside.compare_exchange_weak(max_inside, inside)) ;
+        if (i % 10 == 0)
+            std::this_thread::yield();
+        run->inside--;
+        anydsl_semaphore_release(run->semaphore, 1);
+    }
+    run->done++;
+    return 0;
+}
+
+static void test_semaphore() {
+    SemaphoreRun run;
+    run.limit = 3;
+    run.semaphore = anydsl_semaphore_create(0);
+    run.inside = 0;
+    run.max_inside = 0;
+    run.done = 0;
+    CHECK(!anydsl_semaphore_try_acquire(run.semaphore));
+    std::vector<int32_t> tasks;
+    for (int32_t i = 0; i < num_tasks; ++i)
+        tasks.push_back(anydsl_async(&run, (void*)semaphore_task));
+    // Releasing several units at once wakes up as many waiters
+    anydsl_semaphore_release(run.semaphore, run.limit);
+    for (auto task : tasks)
+        anydsl_wait(task);
+    CHECK(run.done == num_tasks);
+    CHECK(run.max_inside > 0 && run.max_inside <= run.limit);
+    for (int32_t i = 0; i < run.limit; ++i)
+        CHECK(anydsl_semaphore_try_acquire(run.semaphore));
+    CHECK(!anydsl_semaphore_try_acquire(run.semaphore));
+    anydsl_semaphore_destroy(run.semaphore);
+}
+
+// A channel with a capacity of `n` holds the next power of two elements (at least two), in order
+static void test_channel_capacity() {
+    int32_t channel = anydsl_channel_create(sizeof(int64_t), 5);
+    int64_t value = 0;
+    CHECK(!anydsl_channel_try_pop(channel, &value));
+    int32_t pushed = 0;
+    for (int64_t i = 0; anydsl_channel_try_push(channel, &i); ++i)
+        pushed++;
+    CHECK(pushed == 8);
+    bool ordered = true;
+    for (int64_t i = 0; i < pushed; ++i)
+        ordered &= anydsl_channel_try_pop(channel, &value) && value == i;
+    CHECK(ordered);
+    CHECK(!anydsl_channel_try_pop(channel, &value));
+
+    int32_t single = anydsl_channel_create(sizeof(int64_t), 1);
+    int64_t first = 1, second = 2, third = 3;
+    CHECK(anydsl_channel_try_push(single, &first) && anydsl_channel_try_push(single, &second));
+    CHECK(!anydsl_channel_try_push(single, &third));
+    CHECK(anydsl_channel_try_pop(single, &value) && value == 1);
+    CHECK(anydsl_channel_try_pop(single, &value) && value == 2);
+    anydsl_channel_destroy(single);
+
+    int32_t batch[6] = { 1, 2, 3, 4, 5, 6 }, out[8] = {};
+    int32_t ints = anydsl_channel_create(sizeof(int32_t), 4);
+    CHECK(anydsl_channel_try_push_batch(ints, batch, 6) == 4);
+    CHECK(anydsl_channel_try_pop_batch(ints, out, 8) == 4);
+    CHECK(out[0] == 1 && out[3] == 4);
+    anydsl_channel_destroy(ints);
+    anydsl_channel_destroy(channel);
+}
+
+// Closed channels refuse new elements, but are drained before pops fail
+static void test_channel_close() {
+    int32_t channel = anydsl_channel_create(sizeof(int32_t), 4);
+    int32_t values[3] = { 7, 8, 9 }, value = 0;
+    CHECK(anydsl_channel_push_batch(channel, values, 3) == 3);
+    anydsl_channel_close(channel);
+    CHECK(!anydsl_channel_push(channel, &value));
+    CHECK(anydsl_channel_pop(channel, &value) && value == 7);
+    int32_t out[4] = {};
+    CHECK(anydsl_channel_pop_batch(channel, out, 4) == 2);
+    CHECK(out[0] == 8 && out[1] == 9);
+    CHECK(!anydsl_channel_pop(channel, &value));
+    anydsl_channel_destroy(channel);
+}
+
+struct ChannelRun {
+    int32_t channel;
+    int32_t per_producer;
+    std::atomic<int32_t> next_producer;
+    std::vector<std::atomic<int32_t>> received;
+    std::atomic<int32_t> errors;
+
+    ChannelRun(int32_t num_producers, int32_t per_producer)
+        : per_producer(per_producer), next_producer(0), received(num_producers * per_producer), errors(0)
+    {}
+};
+
+// Producers push in batches, the elements of a producer must reach the consumers in order
+static int32_t producer_task(void* data) {
+    auto run = static_cast<ChannelRun*>(data);
+    int32_t producer = run->next_producer++;
+    int32_t batch[7];
+    for (int32_t i = 0; i < run->per_producer; i += 7) {
+        int32_t count = std::min(7, run->per_producer - i);
+        for (int32_t j = 0; j < count; ++j)
+            batch[j] = producer * run->per_producer + i + j;
+        if (anydsl_channel_push_batch(run->channel, batch, count) != count)
+            run->errors++;
+    }
+    return 0;
+}
+
+static int32_t consumer_task(void* data) {
+    auto run = static_cast<ChannelRun*>(data);
+    std::vector<int32_t> last(run->received.size() / run->per_producer, -1);
+    int32_t values[5];
+    while (int32_t count = anydsl_channel_pop_batch(run->channel, values, 5)) {
+        for (int32_t i = 0; i < count; ++i) {
+            int32_t producer = values[i] / run->per_producer;
+            if (values[i] <= last[producer])
+                run->errors++;
+            last[producer] = values[i];
+            run->received[values[i]]++;
+        }
+    }
+    return 0;
+}
+
+// Producers and consumers that outnumber the workers, blocked on a small channel
+static void test_channel_tasks(int32_t num_producers, int32_t num_consumers, int32_t capacity) {
+    ChannelRun run(num_producers, 5000);
+    run.channel = anydsl_channel_create(sizeof(int32_t), capacity);
+    std::vector<int32_t> producers, consumers;
+    for (int32_t i = 0; i < num_consumers; ++i)
+        consumers.push_back(anydsl_async(&run, (void*)consumer_task));
+    for (int32_t i = 0; i < num_producers; ++i)
+        producers.push_back(anydsl_async(&run, (void*)producer_task));
+    for (auto task : producers)
+        anydsl_wait(task);
+    anydsl_channel_close(run.channel);
+    for (auto task : consumers)
+        anydsl_wait(task);
+    bool once = true;
+    for (auto& received : run.received)
+        once &= received.load() == 1;
+    CHECK(once);
+    CHECK(run.errors == 0);
+    anydsl_channel_destroy(run.channel);
+}
+
+struct PipelineRun {
+    int32_t num_stages;
+    int32_t lower;
+    int32_t depth;
+    std::vector<std::atomic<int32_t>> done; ///< Iterations finished by every stage
+    std::atomic<int32_t> errors;
+
+    PipelineRun(int32_t num_stages, int32_t lower, int32_t depth)
+        : num_stages(num_stages), lower(lower), depth(depth), done(num_stages), errors(0)
+    {}
+};
+
+// Checks that stage s runs iteration i after stage s - 1, and at most `depth` iterations ahead of stage s + 1
+static void stage_body(void* data, int32_t stage, int32_t i) {
+    auto run = static_cast<PipelineRun*>(data);
+    int32_t n = i - run->lower;
+    if (run->done[stage].load() != n)
+        run->errors++;
+    if (stage > 0 && run->done[stage - 1].load() <= n)
+        run->errors++;
+    if (stage + 1 < run->num_stages && run->done[stage + 1].load() < n + 1 - run->depth)
+        run->errors++;
+    run->done[stage]++;
+}
+
+static void test_pipeline(int32_t num_stages, int32_t depth) {
+    PipelineRun run(num_stages, 5, depth > 0 ? depth : 64);
+    anydsl_pipeline_for(num_stages, 5, 1005, depth, &run, (void*)stage_body);
+    for (int32_t s = 0; s < num_stages; ++s)
+        CHECK(run.done[s] == 1000);
+    CHECK(run.errors == 0);
+}
+
+static void empty_body(void*, int32_t, int32_t) {}
+
+static void loop_stage_body(void* data, int32_t stage, int32_t i) {
+    anydsl_parallel_for(4, 0, 64, nullptr, (void*)empty_body);
+    stage_body(data, stage, i);
+}
+
+// Stages that wait for a loop: a thread waiting for the loop in stage s must not pick up
+// stage s + 1, which would wait for stage s below it on the stack
+static void test_loop_stages() {
+    PipelineRun run(4, 0, 2);
+    anydsl_pipeline_for(4, 0, 100, 2, &run, (void*)loop_stage_body);
+    for (int32_t s = 0; s < 4; ++s)
+        CHECK(run.done[s] == 100);
+    CHECK(run.errors == 0);
+}
+
+int main() {
+    test_barrier();
+    test_latch();
+    test_semaphore();
+    test_channel_capacity();
+    test_channel_close();
+    test_channel_tasks(1, 1, 1);
+    test_channel_tasks(4, 1, 8);
+    test_channel_tasks(1, 4, 8);
+    test_channel_tasks(6, 6, 16);
+    test_pipeline(1, 0);
+    test_pipeline(3, 0);
+    test_pipeline(4, 1);
+    test_pipeline(8, 3);
+    test_loop_stages();
+    if (failures == 0)
+        std::printf("all checks passed\n");
+    return failures == 0 ? 0 : 1;
+}